@@ -91,6 +91,43 @@ flush_block(void *addr)
 	sys_page_map(thisenv->env_id, addr, thisenv->env_id, addr, PTE_SYSCALL);
 }
 
+// Drop blockno, which has just been freed, from the block cache
+// without writing it back.  Clients that mapped its page through
+// serve_map keep the old contents instead of seeing whatever the block
+// is reused for; the next use of the block faults in a fresh page.
+void
+bc_drop(uint32_t blockno)
+{
+	void *addr = diskaddr(blockno);
+	int r;
+
+	if (va_is_mapped(addr) && (r = sys_page_unmap(0, addr)) < 0)
+		panic("bc_drop: %e", r);
+}
+
+// Give the block cache its own copy of the page holding addr if a
+// client has it mapped too (through serve_map), so that the write the
+// caller is about to make doesn't show through to the client: a
+// program's copy-on-write data, or text, must not change under it.
+// Returns 0 or < 0 on error.
+int
+bc_unshare(void *addr)
+{
+	int r;
+
+	addr = ROUNDDOWN(addr, BLKSIZE);
+	if (!va_is_mapped(addr) || pageref(addr) <= 1)
+		return 0;
+	if ((r = sys_page_alloc(0, UTEMP, PTE_P|PTE_U|PTE_W)) < 0)
+		return r;
+	memmove(UTEMP, addr, BLKSIZE);
+	// The caller's write marks the new mapping dirty.
+	if ((r = sys_page_map(0, UTEMP, 0, addr, PTE_P|PTE_U|PTE_W)) < 0)
+		panic("bc_unshare: %e", r);
+	sys_page_unmap(0, UTEMP);
+	return 0;
+}
+
 // Test that the block cache works, by smashing the superblock and
 // reading it back.
 static void
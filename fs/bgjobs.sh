@@ -0,0 +1,5 @@
+echo Starting background jobs.
+pipebench 512 &
+pipebench 512 &
+cat lorem | num | cat
+echo Done.
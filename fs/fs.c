@@ -1,5 +1,6 @@
 #include <inc/string.h>
 #include <inc/partition.h>
+#include <inc/x86.h>
 
 #include "fs.h"
 
@@ -42,6 +43,25 @@ block_is_free(uint32_t blockno)
 	return 0;
 }
 
+// Number of free blocks described by each bitmap block.  Lets
+// alloc_block_near skip completely allocated stretches of the disk
+// without touching their bitmap words.  Built by bitmap_summary_init.
+static uint32_t bitmap_nfree[DISKSIZE / BLKSIZE / BLKBITSIZE];
+
+// Where the next allocation without a better goal starts searching.
+static uint32_t alloc_rotor;
+
+// Count the set bits in 'x'.
+static int
+bitcount(uint32_t x)
+{
+	int n;
+
+	for (n = 0; x; n++)
+		x &= x - 1;
+	return n;
+}
+
 // Mark a block free in the bitmap
 void
 free_block(uint32_t blockno)
@@ -49,37 +69,111 @@ free_block(uint32_t blockno)
 	// Blockno zero is the null pointer of block numbers.
 	if (blockno == 0)
 		panic("attempt to free zero block");
+	// Not while the journal could still replay old metadata over it.
+	if (journal_free(blockno))
+		return;
+	if (!(bitmap[blockno/32] & (1<<(blockno%32))))
+		bitmap_nfree[blockno / BLKBITSIZE]++;
 	bitmap[blockno/32] |= 1<<(blockno%32);
+	journal_add(&bitmap[blockno/32]);
+	bc_drop(blockno);
+}
+
+// Search bitmap words [w, wend) for a free block and return its
+// number, or -1 if there is none.  Bits below 'goal' in the first
+// word are ignored, so the caller can start mid-word.
+static int
+bitmap_scan(uint32_t w, uint32_t wend, uint32_t goal)
+{
+	uint32_t bits;
+
+	for (; w < wend; w++) {
+		bits = bitmap[w];
+		if (w == goal / 32)
+			bits &= ~0U << (goal % 32);
+		if (bits == 0)
+			continue;
+		if (w * 32 + bsf(bits) >= super->s_nblocks)
+			return -1;
+		return w * 32 + bsf(bits);
+	}
+	return -1;
 }
 
-// Search the bitmap for a free block and allocate it.  When you
-// allocate a block, immediately flush the changed bitmap block
-// to disk.
+// Search the bitmap for a free block, preferring 'goal' and then the
+// first free block after it, and allocate it.  The search runs a
+// 32-bit bitmap word at a time and skips bitmap blocks whose summary
+// count says they are full.  When you allocate a block, immediately
+// flush the changed bitmap block to disk (or to the journal).
 //
 // Return block number allocated on success,
 // -E_NO_DISK if we are out of blocks.
-//
-// Hint: use free_block as an example for manipulating the bitmap.
+int
+alloc_block_near(uint32_t goal)
+{
+	uint32_t nbitblocks, bb, i, wend;
+	int blockno;
+	void *addr;
+
+	if (goal >= super->s_nblocks)
+		goal = 0;
+	nbitblocks = (super->s_nblocks + BLKBITSIZE - 1) / BLKBITSIZE;
+	blockno = -1;
+
+	// Finish the goal's bitmap block, then visit every bitmap block
+	// once in order (wrapping), which ends back at the goal's block.
+	bb = goal / BLKBITSIZE;
+	if (bitmap_nfree[bb])
+		blockno = bitmap_scan(goal / 32, (bb + 1) * BLKBITSIZE / 32, goal);
+	for (i = 1; blockno < 0 && i <= nbitblocks; i++) {
+		bb = (goal / BLKBITSIZE + i) % nbitblocks;
+		if (bitmap_nfree[bb] == 0)
+			continue;
+		wend = (bb + 1) * BLKBITSIZE / 32;
+		if (i == nbitblocks)
+			wend = goal / 32 + 1;
+		blockno = bitmap_scan(bb * BLKBITSIZE / 32, wend, 0);
+	}
+	if (blockno < 0)
+		return -E_NO_DISK;
+
+	bitmap[blockno/32] &= ~(1<<(blockno%32));
+	bitmap_nfree[blockno / BLKBITSIZE]--;
+	meta_flush(&bitmap[blockno/32]);
+	// Freed blocks leave the cache, so give the block a fresh page
+	// instead of reading in old contents only to zero them.  (If that
+	// fails, the memset faults the block in as usual.)
+	addr = diskaddr(blockno);
+	if (!va_is_mapped(addr))
+		sys_page_alloc(0, addr, PTE_P|PTE_U|PTE_W);
+	memset(addr, 0, BLKSIZE);
+	alloc_rotor = blockno + 1;
+	return blockno;
+}
+
+// Allocate a block with no placement preference.  The search continues
+// from wherever the previous allocation left off.
 int
 alloc_block(void)
 {
-	// The bitmap consists of one or more blocks.  A single bitmap block
-	// contains the in-use bits for BLKBITSIZE blocks.  There are
-	// super->s_nblocks blocks in the disk altogether.
+	return alloc_block_near(alloc_rotor);
+}
 
-	// LAB 5: Your code here.
-	uint32_t total_blocks = super->s_nblocks;
-	for(uint32_t blockno = 0; blockno < total_blocks; blockno++)
-	{
-		if(block_is_free(blockno))
-		{
-			bitmap[blockno/32] ^= 1<<(blockno%32);
-			flush_block(bitmap);
-			memset(diskaddr(blockno), 0, BLKSIZE);
-			return blockno;
-		}
-	}
-	return -E_NO_DISK;
+// Count the free blocks under each bitmap block.
+static void
+bitmap_summary_init(void)
+{
+	uint32_t w, nwords;
+
+	memset(bitmap_nfree, 0, sizeof(bitmap_nfree));
+	nwords = (super->s_nblocks + 31) / 32;
+	for (w = 0; w < nwords; w++)
+		bitmap_nfree[w * 32 / BLKBITSIZE] += bitcount(bitmap[w]);
+	// fsformat marks the tail of the last bitmap word free even
+	// though those blocks don't exist.
+	if (super->s_nblocks % 32)
+		bitmap_nfree[(nwords - 1) * 32 / BLKBITSIZE] -=
+			bitcount(bitmap[nwords - 1] & (~0U << (super->s_nblocks % 32)));
 }
 
 // Validate the file system bitmap.
@@ -124,11 +218,12 @@ fs_init(void)
 	// Set "super" to point to the super block.
 	super = diskaddr(1);
 	check_super();
+	journal_init();
 
 	// Set "bitmap" to the beginning of the first bitmap block.
 	bitmap = diskaddr(2);
 	check_bitmap();
-	
+	bitmap_summary_init();
 }
 
 // Find the disk block number slot for the 'filebno'th block in file 'f'.
@@ -173,12 +268,22 @@ file_block_walk(struct File *f, uint32_t filebno, uint32_t **ppdiskbno, bool all
 	}
 	if(f->f_indirect == 0)
 	{
-		uint32_t blockno = alloc_block();
+		// Right after the last data block the file has, which a
+		// sparse file need not have in f_direct[NDIRECT - 1].
+		uint32_t i, goal = alloc_rotor;
+		for (i = NDIRECT; i > 0; i--)
+			if (f->f_direct[i - 1]) {
+				goal = f->f_direct[i - 1] + 1;
+				break;
+			}
+		uint32_t blockno = alloc_block_near(goal);
 		if(blockno == -E_NO_DISK)
 		{
 			return -E_NO_DISK;
 		}
 		f->f_indirect = blockno;
+		journal_add(f);
+		journal_add(diskaddr(blockno));
 	}
 	if(ppdiskbno)
 	{
@@ -188,6 +293,34 @@ file_block_walk(struct File *f, uint32_t filebno, uint32_t **ppdiskbno, bool all
 	return 0;
 }
 
+// How far past a taken goal to start looking instead, so that files
+// growing at the same time end up in runs of about this many blocks
+// rather than taking turns block by block.
+#define ALLOC_SPREAD	32
+
+// Pick the disk block where the filebno'th block of file 'f' would
+// best be placed: right after the file's previous block (and its
+// indirect block, if that went there), so that sequential writes lay
+// a file out contiguously.  If another file got there first, skip
+// ALLOC_SPREAD blocks ahead.  Falls back to the global allocation
+// rotor for a file's first block.
+static uint32_t
+file_block_goal(struct File *f, uint32_t filebno)
+{
+	uint32_t *pdiskbno, goal;
+
+	if (filebno > 0 && file_block_walk(f, filebno - 1, &pdiskbno, 0) == 0
+	    && *pdiskbno) {
+		goal = *pdiskbno + 1;
+		if (goal == f->f_indirect)
+			goal++;
+		if (!block_is_free(goal))
+			goal += ALLOC_SPREAD;
+		return goal;
+	}
+	return alloc_rotor;
+}
+
 // Set *blk to the address in memory where the filebno'th
 // block of file 'f' would be mapped.
 //
@@ -220,33 +353,138 @@ file_get_block(struct File *f, uint32_t filebno, char **blk)
 	}
 	else
 	{
-		uint32_t blockno = alloc_block();
+		uint32_t blockno = alloc_block_near(file_block_goal(f, filebno));
 		if(blockno == -E_NO_DISK)
 		{
 			return -E_NO_DISK;
 		}
 		*block_slot = blockno;
+		journal_add(block_slot);
 		*blk = diskaddr(blockno);
 	}
 	return 0;
 }
 
+// Directories with at least this many blocks get a hash index the
+// next time an entry is added to them.
+#define DIR_INDEX_MINBLOCKS	2
+
+// Does 'dir' have a hash index that we may use?  Images formatted
+// before FS_FEAT_DIRINDEX may have garbage in the index fields, so
+// they are only trusted when the super block says so.
+static bool
+dir_indexed(struct File *dir)
+{
+	return (super->s_features & FS_FEAT_DIRINDEX) && dir->f_dirhash;
+}
+
+// Blocks an index build journals on top of the directory's nblock
+// blocks: the bucket block, the block holding dir's own File, and its
+// indirect block.
+#define DIR_INDEX_EXTRA		3
+
+// Should adding an entry that leaves dir with nblock blocks build its
+// hash index?  Building touches every block, so a directory too large
+// for that to fit in one journal transaction (one formatted before
+// directories were indexed) stays unindexed instead.
+static bool
+dir_index_due(struct File *dir, uint32_t nblock)
+{
+	return (super->s_features & FS_FEAT_DIRINDEX) && !dir->f_dirhash
+		&& nblock >= DIR_INDEX_MINBLOCKS
+		&& journal_fits(nblock + DIR_INDEX_EXTRA);
+}
+
+// Set *pf to the File structure in slot 'slot' of dir.
+static int
+dir_slot(struct File *dir, uint32_t slot, struct File **pf)
+{
+	int r;
+	char *blk;
+
+	if ((r = file_get_block(dir, slot / BLKFILES, &blk)) < 0)
+		return r;
+	*pf = (struct File*) blk + slot % BLKFILES;
+	return 0;
+}
+
+// Link entry f, which sits in slot 'slot' of dir, into the head of its
+// hash chain.
+static void
+dir_index_insert(struct File *dir, uint32_t slot, struct File *f)
+{
+	uint32_t *buckets = diskaddr(dir->f_dirhash);
+	uint32_t h = dir_hash(f->f_name) % DIR_NBUCKETS;
+
+	f->f_hnext = buckets[h];
+	buckets[h] = slot + 1;
+	journal_add(f);
+	journal_add(buckets);
+}
+
+// Give dir a hash index covering all its current entries.  The entries
+// are flushed before the directory points at the new index.
+static int
+dir_index_build(struct File *dir)
+{
+	int r;
+	uint32_t slot, nslot;
+	struct File *f;
+
+	if ((r = alloc_block()) < 0)
+		return r;
+	dir->f_dirhash = r;
+	nslot = dir->f_size / sizeof(struct File);
+	for (slot = 0; slot < nslot; slot++) {
+		if ((r = dir_slot(dir, slot, &f)) < 0)
+			goto fail;
+		if (f->f_name[0] != '\0')
+			dir_index_insert(dir, slot, f);
+	}
+	file_flush(dir);
+	meta_flush(diskaddr(dir->f_dirhash));
+	return 0;
+
+fail:
+	free_block(dir->f_dirhash);
+	dir->f_dirhash = 0;
+	return r;
+}
+
 // Try to find a file named "name" in dir.  If so, set *file to it.
 //
+// Indexed directories only walk the name's hash chain; others fall
+// back to comparing every entry.
+//
 // Returns 0 and sets *file on success, < 0 on error.  Errors are:
 //	-E_NOT_FOUND if the file is not found
 static int
 dir_lookup(struct File *dir, const char *name, struct File **file)
 {
 	int r;
-	uint32_t i, j, nblock;
+	uint32_t i, j, nblock, slot, nslot;
 	char *blk;
 	struct File *f;
 
-	// Search dir for name.
 	// We maintain the invariant that the size of a directory-file
 	// is always a multiple of the file system's block size.
 	assert((dir->f_size % BLKSIZE) == 0);
+
+	if (dir_indexed(dir)) {
+		nslot = dir->f_size / sizeof(struct File);
+		slot = ((uint32_t*) diskaddr(dir->f_dirhash))[dir_hash(name) % DIR_NBUCKETS];
+		for (; slot != 0 && slot <= nslot; slot = f->f_hnext) {
+			if ((r = dir_slot(dir, slot - 1, &f)) < 0)
+				return r;
+			if (strcmp(f->f_name, name) == 0) {
+				*file = f;
+				return 0;
+			}
+		}
+		return -E_NOT_FOUND;
+	}
+
+	// Search dir for name.
 	nblock = dir->f_size / BLKSIZE;
 	for (i = 0; i < nblock; i++) {
 		if ((r = file_get_block(dir, i, &blk)) < 0)
@@ -261,36 +499,117 @@ dir_lookup(struct File *dir, const char *name, struct File **file)
 	return -E_NOT_FOUND;
 }
 
-// Set *file to point at a free File structure in dir.  The caller is
-// responsible for filling in the File fields.
+// Find a free File structure in dir, name it 'name', and set *file to
+// point at it.  The caller is responsible for filling in the other
+// File fields.  The search starts at the directory's free-slot hint,
+// and the entry is added to the directory's hash index, building the
+// index first if the directory has grown large enough to need one.
 static int
-dir_alloc_file(struct File *dir, struct File **file)
+dir_alloc_file(struct File *dir, const char *name, struct File **file)
 {
 	int r;
-	uint32_t nblock, i, j;
-	char *blk;
+	uint32_t slot, nslot;
+	bool indexed;
 	struct File *f;
 
 	assert((dir->f_size % BLKSIZE) == 0);
-	nblock = dir->f_size / BLKSIZE;
-	for (i = 0; i < nblock; i++) {
-		if ((r = file_get_block(dir, i, &blk)) < 0)
+	indexed = super->s_features & FS_FEAT_DIRINDEX;
+	nslot = dir->f_size / sizeof(struct File);
+	for (slot = indexed ? MIN(dir->f_dirfree, nslot) : 0; slot < nslot; slot++) {
+		if ((r = dir_slot(dir, slot, &f)) < 0)
 			return r;
-		f = (struct File*) blk;
-		for (j = 0; j < BLKFILES; j++)
-			if (f[j].f_name[0] == '\0') {
-				*file = &f[j];
-				return 0;
-			}
+		if (f->f_name[0] == '\0')
+			break;
 	}
-	dir->f_size += BLKSIZE;
-	if ((r = file_get_block(dir, i, &blk)) < 0)
-		return r;
-	f = (struct File*) blk;
-	*file = &f[0];
+	if (slot == nslot) {
+		dir->f_size += BLKSIZE;
+		if ((r = dir_slot(dir, slot, &f)) < 0) {
+			dir->f_size -= BLKSIZE;
+			return r;
+		}
+		journal_add(dir);
+	}
+	strcpy(f->f_name, name);
+	journal_add(f);
+
+	if (indexed) {
+		dir->f_dirfree = slot + 1;
+		if (dir_index_due(dir, dir->f_size / BLKSIZE))
+			// The new entry is indexed along with the rest.
+			dir_index_build(dir);
+		else if (dir->f_dirhash) {
+			dir_index_insert(dir, slot, f);
+			meta_flush(diskaddr(dir->f_dirhash));
+		}
+	}
+	*file = f;
 	return 0;
 }
 
+// --------------------------------------------------------------
+// Name cache
+// --------------------------------------------------------------
+
+// A direct-mapped cache of recent dir_lookup results, keyed by the
+// directory's File and the name looked up in it.  A null d_file
+// records that the name does not exist.  File structures never move
+// in the block cache, so the cached pointers stay valid; an entry only
+// goes stale when the directory changes, which file_create handles.
+#define DCACHE_SIZE	256		// must be a power of 2
+
+struct Dentry {
+	struct File *d_dir;		// directory searched; 0 if unused
+	struct File *d_file;		// what we found, or 0 if not found
+	char d_name[MAXNAMELEN];
+};
+
+static struct Dentry dcache[DCACHE_SIZE];
+static uint32_t dcache_hits, dcache_neghits, dcache_misses;
+
+static struct Dentry *
+dcache_slot(struct File *dir, const char *name)
+{
+	return &dcache[(dir_hash(name) ^ ((uint32_t) dir / sizeof(struct File)))
+		       % DCACHE_SIZE];
+}
+
+// Remember that looking up 'name' in 'dir' yields f (0 if nothing).
+static void
+dcache_enter(struct File *dir, const char *name, struct File *f)
+{
+	struct Dentry *d = dcache_slot(dir, name);
+
+	d->d_dir = dir;
+	d->d_file = f;
+	strcpy(d->d_name, name);
+}
+
+// dir_lookup, answered from the name cache when possible.
+static int
+dir_lookup_cached(struct File *dir, const char *name, struct File **file)
+{
+	struct Dentry *d = dcache_slot(dir, name);
+	int r;
+
+	if (d->d_dir == dir && strcmp(d->d_name, name) == 0) {
+		if (!d->d_file) {
+			dcache_neghits++;
+			return -E_NOT_FOUND;
+		}
+		dcache_hits++;
+		*file = d->d_file;
+		return 0;
+	}
+
+	dcache_misses++;
+	r = dir_lookup(dir, name, file);
+	if (r == 0)
+		dcache_enter(dir, name, *file);
+	else if (r == -E_NOT_FOUND)
+		dcache_enter(dir, name, 0);
+	return r;
+}
+
 // Skip over slashes.
 static const char*
 skip_slash(const char *p)
@@ -338,7 +657,7 @@ walk_path(const char *path, struct File **pdir, struct File **pf, char *lastelem
 		if (dir->f_type != FTYPE_DIR)
 			return -E_NOT_FOUND;
 
-		if ((r = dir_lookup(dir, name, &f)) < 0) {
+		if ((r = dir_lookup_cached(dir, name, &f)) < 0) {
 			if (r == -E_NOT_FOUND && *path == '\0') {
 				if (pdir)
 					*pdir = dir;
@@ -367,18 +686,32 @@ file_create(const char *path, struct File **pf)
 {
 	char name[MAXNAMELEN];
 	int r;
+	uint32_t nblock;
 	struct File *dir, *f;
 
 	if ((r = walk_path(path, &dir, &f, name)) == 0)
 		return -E_FILE_EXISTS;
 	if (r != -E_NOT_FOUND || dir == 0)
 		return r;
-	if ((r = dir_alloc_file(dir, &f)) < 0)
+	// Adding the entry changes only a few blocks, which the request's
+	// own reservation covers, unless it is the entry that gets the
+	// directory indexed: that touches every block, including one the
+	// entry may add.
+	nblock = dir->f_size / BLKSIZE + 1;
+	if (dir_index_due(dir, nblock))
+		journal_begin(nblock + DIR_INDEX_EXTRA);
+	if ((r = dir_alloc_file(dir, name, &f)) < 0)
 		return r;
+	// Replaces the negative entry walk_path just left behind.
+	dcache_enter(dir, name, f);
 
-	strcpy(f->f_name, name);
 	*pf = f;
-	file_flush(dir);
+	// Only the new entry's block and the directory's own metadata have
+	// changed, so don't walk every block of a large directory.
+	meta_flush(f);
+	meta_flush(dir);
+	if (dir->f_indirect)
+		meta_flush(diskaddr(dir->f_indirect));
 	return 0;
 }
 
@@ -436,7 +769,8 @@ file_write(struct File *f, const void *buf, size_t count, off_t offset)
 			return r;
 
 	for (pos = offset; pos < offset + count; ) {
-		if ((r = file_get_block(f, pos / BLKSIZE, &blk)) < 0)
+		if ((r = file_get_block(f, pos / BLKSIZE, &blk)) < 0
+		    || (r = bc_unshare(blk)) < 0)
 			return r;
 		bn = MIN(BLKSIZE - pos % BLKSIZE, offset + count - pos);
 		memmove(blk + pos % BLKSIZE, buf, bn);
@@ -460,6 +794,7 @@ file_free_block(struct File *f, uint32_t filebno)
 	if (*ptr) {
 		free_block(*ptr);
 		*ptr = 0;
+		journal_add(ptr);
 	}
 	return 0;
 }
@@ -488,6 +823,7 @@ file_truncate_blocks(struct File *f, off_t newsize)
 	if (new_nblocks <= NDIRECT && f->f_indirect) {
 		free_block(f->f_indirect);
 		f->f_indirect = 0;
+		journal_add(f);
 	}
 }
 
@@ -498,7 +834,7 @@ file_set_size(struct File *f, off_t newsize)
 	if (f->f_size > newsize)
 		file_truncate_blocks(f, newsize);
 	f->f_size = newsize;
-	flush_block(f);
+	meta_flush(f);
 	return 0;
 }
 
@@ -506,6 +842,8 @@ file_set_size(struct File *f, off_t newsize)
 // Loop over all the blocks in file.
 // Translate the file block number into a disk block number
 // and then check whether that disk block is dirty.  If so, write it out.
+// A directory's blocks are metadata and go through the journal, like
+// the file's own; they reach the disk with the next group commit.
 void
 file_flush(struct File *f)
 {
@@ -516,19 +854,84 @@ file_flush(struct File *f)
 		if (file_block_walk(f, i, &pdiskbno, 0) < 0 ||
 		    pdiskbno == NULL || *pdiskbno == 0)
 			continue;
-		flush_block(diskaddr(*pdiskbno));
+		if (f->f_type == FTYPE_DIR)
+			meta_flush(diskaddr(*pdiskbno));
+		else
+			flush_block(diskaddr(*pdiskbno));
 	}
-	flush_block(f);
+	meta_flush(f);
 	if (f->f_indirect)
-		flush_block(diskaddr(f->f_indirect));
+		meta_flush(diskaddr(f->f_indirect));
 }
 
 
+// Count the runs of physically contiguous blocks that make up file f.
+static uint32_t
+file_count_extents(struct File *f)
+{
+	uint32_t i, nblocks, prev, n;
+	uint32_t *pdiskbno;
+
+	n = 0;
+	prev = 0;
+	nblocks = (f->f_size + BLKSIZE - 1) / BLKSIZE;
+	for (i = 0; i < nblocks; i++) {
+		if (file_block_walk(f, i, &pdiskbno, 0) < 0 || *pdiskbno == 0)
+			continue;
+		if (*pdiskbno != prev + 1)
+			n++;
+		prev = *pdiskbno;
+	}
+	return n;
+}
+
+// Fill in a fragmentation report: free space as runs of free blocks,
+// and how many extents the files in the root directory are split into.
+// Also report how well the name cache is doing.
+void
+fs_statfs(struct Fsret_statfs *st)
+{
+	uint32_t blockno, run, i, j, nblock;
+	struct File *f;
+	char *blk;
+
+	memset(st, 0, sizeof(*st));
+	st->ret_nblocks = super->s_nblocks;
+	st->ret_dchits = dcache_hits;
+	st->ret_dcneghits = dcache_neghits;
+	st->ret_dcmisses = dcache_misses;
+	run = 0;
+	for (blockno = 0; blockno < super->s_nblocks; blockno++) {
+		if (block_is_free(blockno)) {
+			st->ret_nfree++;
+			if (run++ == 0)
+				st->ret_nfreeext++;
+			st->ret_maxfreeext = MAX(st->ret_maxfreeext, run);
+		} else
+			run = 0;
+	}
+
+	nblock = super->s_root.f_size / BLKSIZE;
+	for (i = 0; i < nblock; i++) {
+		if (file_get_block(&super->s_root, i, &blk) < 0)
+			break;
+		f = (struct File*) blk;
+		for (j = 0; j < BLKFILES; j++) {
+			if (f[j].f_name[0] == '\0' || f[j].f_type != FTYPE_REG)
+				continue;
+			st->ret_nfiles++;
+			st->ret_nfileext += file_count_extents(&f[j]);
+		}
+	}
+}
+
 // Sync the entire file system.  A big hammer.
 void
 fs_sync(void)
 {
 	int i;
+
+	journal_sync();
 	for (i = 1; i < super->s_nblocks; i++)
 		flush_block(diskaddr(i));
 }
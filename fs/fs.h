@@ -26,8 +26,26 @@ void*	diskaddr(uint32_t blockno);
 bool	va_is_mapped(void *va);
 bool	va_is_dirty(void *va);
 void	flush_block(void *addr);
+void	bc_drop(uint32_t blockno);
+int	bc_unshare(void *addr);
 void	bc_init(void);
 
+/* journal.c */
+void	journal_init(void);
+int	journal_recover(void);
+bool	journal_fits(uint32_t n);
+void	journal_begin(uint32_t n);
+void	journal_add(void *addr);
+void	meta_flush(void *addr);
+bool	journal_free(uint32_t blockno);
+void	journal_commit(void);
+void	journal_sync(void);
+bool	journal_pending(void);
+void	journal_request_done(void);
+// Crash-injection point for journal_crash
+#define JOURNAL_CRASH_PRECOMMIT		1	// before the header is written
+extern int journal_crash;
+
 /* fs.c */
 void	fs_init(void);
 int	file_get_block(struct File *f, uint32_t file_blockno, char **pblk);
@@ -39,10 +57,13 @@ int	file_set_size(struct File *f, off_t newsize);
 void	file_flush(struct File *f);
 int	file_remove(const char *path);
 void	fs_sync(void);
+void	fs_statfs(struct Fsret_statfs *st);
 
 /* int	map_block(uint32_t); */
 bool	block_is_free(uint32_t blockno);
 int	alloc_block(void);
+int	alloc_block_near(uint32_t goal);
+void	free_block(uint32_t blockno);
 
 /* test.c */
 void	fs_test(void);
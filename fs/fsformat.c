@@ -33,6 +33,7 @@ typedef int bool;
 
 #define ROUNDUP(n, v) ((n) - 1 + (v) - ((n) - 1) % (v))
 #define MAX_DIR_ENTS 128
+#define NJOURNAL 64
 
 struct Dir
 {
@@ -111,12 +112,17 @@ opendisk(const char *name)
 	super = alloc(BLKSIZE);
 	super->s_magic = FS_MAGIC;
 	super->s_nblocks = nblocks;
+	super->s_features = FS_FEAT_DIRINDEX;
 	super->s_root.f_type = FTYPE_DIR;
 	strcpy(super->s_root.f_name, "/");
 
 	nbitblocks = (nblocks + BLKBITSIZE - 1) / BLKBITSIZE;
 	bitmap = alloc(nbitblocks * BLKSIZE);
 	memset(bitmap, 0xFF, nbitblocks * BLKSIZE);
+
+	// The journal starts out empty: its super block is zero.
+	super->s_journal = blockof(alloc(NJOURNAL * BLKSIZE));
+	super->s_njournal = NJOURNAL;
 }
 
 void
@@ -151,7 +157,7 @@ void
 startdir(struct File *f, struct Dir *dout)
 {
 	dout->f = f;
-	dout->ents = malloc(MAX_DIR_ENTS * sizeof *dout->ents);
+	dout->ents = calloc(MAX_DIR_ENTS, sizeof *dout->ents);
 	dout->n = 0;
 }
 
@@ -166,6 +172,24 @@ diradd(struct Dir *d, uint32_t type, const char *name)
 	return out;
 }
 
+// Build the hash index for the n entries of directory f, laid out
+// starting at ents.
+void
+dirindex(struct File *f, struct File *ents, int n)
+{
+	uint32_t *buckets = alloc(BLKSIZE);
+	uint32_t h;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		h = dir_hash(ents[i].f_name) % DIR_NBUCKETS;
+		ents[i].f_hnext = buckets[h];
+		buckets[h] = i + 1;
+	}
+	f->f_dirhash = blockof(buckets);
+	f->f_dirfree = n;
+}
+
 void
 finishdir(struct Dir *d)
 {
@@ -173,6 +197,7 @@ finishdir(struct Dir *d)
 	struct File *start = alloc(size);
 	memmove(start, d->ents, size);
 	finishfile(d->f, blockof(start), ROUNDUP(size, BLKSIZE));
+	dirindex(d->f, start, d->n);
 	free(d->ents);
 	d->ents = NULL;
 }
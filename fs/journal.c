@@ -0,0 +1,428 @@
+/*
+ * Metadata journal.
+ *
+ * Changes to metadata blocks -- the bitmap, directory blocks, indirect
+ * blocks and the super block -- are collected into a transaction by
+ * journal_add instead of being written in place.  Metadata blocks only
+ * ever reach their home locations through the journal.
+ *
+ * The journal area is a circular log.  Its first block says where the
+ * oldest live transaction starts and what its sequence number is.  A
+ * transaction is a header block listing the home block numbers of its
+ * blocks, followed by copies of them.  journal_commit writes every
+ * dirty data block home, then the copies, then the header, which is
+ * the commit point.  The blocks themselves stay dirty in the cache:
+ * the checkpoint that writes them home is put off until the log runs
+ * short of room, or until sync, so a block changed by many commits is
+ * written home once.  At mount, journal_recover replays every
+ * committed transaction in the log, in order; one whose header never
+ * made it to disk is ignored.
+ *
+ * Operations never straddle a commit.  Each request reserves room for
+ * the most it can journal with journal_begin before it changes
+ * anything, and commits happen only there, between requests
+ * (journal_request_done, once JOURNAL_GROUP requests have changed
+ * metadata), when the server goes idle, and on sync.
+ *
+ * A metadata block freed while its old contents are still in the log
+ * is not handed out again until the next checkpoint, so that replaying
+ * the log can never write over what it has become since.  A crash
+ * before then leaks it.
+ *
+ * Images without a journal area (s_journal == 0) write metadata in
+ * place, as they always did.
+ */
+
+#include "fs.h"
+
+#define JSUPER_MAGIC	0x4A4E4C53	// 'JNLS'
+#define JOURNAL_MAGIC	0x4A4E4C32	// 'JNL2'
+#define JOURNAL_GROUP	8
+// Blocks one request may journal besides the bitmap and whatever it
+// asks journal_begin for on top.
+#define JOURNAL_OPBLOCKS	8
+
+struct JournalSuper {
+	uint32_t js_magic;		// JSUPER_MAGIC
+	uint32_t js_start;		// log block of the oldest transaction
+	uint32_t js_seq;		// its sequence number
+	uint32_t js_sum;
+};
+
+struct JournalHeader {
+	uint32_t jh_magic;		// JOURNAL_MAGIC if committed
+	uint32_t jh_seq;		// commit sequence number
+	uint32_t jh_nblocks;		// blocks in this transaction
+	uint32_t jh_sum;		// checksum of the header
+	uint32_t jh_blocks[(BLKSIZE - 16) / 4];	// home block numbers
+};
+
+static union {
+	struct JournalSuper s;
+	char buf[BLKSIZE];
+} jsuper;
+static union {
+	struct JournalHeader h;
+	char buf[BLKSIZE];
+} jhdr;
+static char jblock[BLKSIZE];
+
+static uint32_t jnl_n;			// blocks in the open transaction
+static uint32_t jnl_nreq;		// requests that added to it
+static bool jnl_changed;		// this request journaled something
+static uint32_t jnl_seq;		// sequence number of the next commit
+static uint32_t jnl_head;		// log block for the next commit
+static uint32_t jnl_used;		// log blocks holding live commits
+
+// Per-block flags: holds metadata, is in the open transaction, is
+// committed but not yet written home.
+#define JNL_NWORDS	(DISKSIZE / BLKSIZE / 32)
+static uint32_t jnl_meta[JNL_NWORDS];
+static uint32_t jnl_open[JNL_NWORDS];
+static uint32_t jnl_pending[JNL_NWORDS];
+
+// Freed blocks waiting for the next checkpoint (see journal_free).
+#define JNL_MAXDEFER	(2 * ARRAY_SIZE(jhdr.h.jh_blocks))
+static uint32_t jnl_defer[JNL_MAXDEFER];
+static uint32_t jnl_ndefer;
+
+// Crash injection for fs_test: stop journal_commit at this point.
+int journal_crash;
+
+static bool
+bit_test(uint32_t *map, uint32_t b)
+{
+	return (map[b / 32] >> (b % 32)) & 1;
+}
+
+static void
+bit_set(uint32_t *map, uint32_t b)
+{
+	map[b / 32] |= 1 << (b % 32);
+}
+
+static void
+bit_clear(uint32_t *map, uint32_t b)
+{
+	map[b / 32] &= ~(1 << (b % 32));
+}
+
+static bool
+journal_enabled(void)
+{
+	return super->s_journal != 0 && super->s_njournal >= 2;
+}
+
+// Blocks in the circular log, after the journal super block.
+static uint32_t
+journal_logsize(void)
+{
+	return super->s_njournal - 1;
+}
+
+// Largest transaction that fits in the log.
+static uint32_t
+journal_max(void)
+{
+	return MIN(journal_logsize() - 1, ARRAY_SIZE(jhdr.h.jh_blocks));
+}
+
+static uint32_t
+journal_sum(struct JournalHeader *h)
+{
+	uint32_t i, sum;
+
+	sum = h->jh_magic ^ h->jh_seq ^ h->jh_nblocks;
+	for (i = 0; i < h->jh_nblocks; i++)
+		sum = (sum ^ h->jh_blocks[i]) * 16777619U;
+	return sum;
+}
+
+static uint32_t
+jsuper_sum(struct JournalSuper *js)
+{
+	return (js->js_magic ^ js->js_start ^ js->js_seq) * 16777619U;
+}
+
+// Sector of log block pos.
+static uint32_t
+journal_sect(uint32_t pos)
+{
+	return (super->s_journal + 1 + pos % journal_logsize()) * BLKSECTS;
+}
+
+// Record that the log is empty from jnl_head on.
+static void
+journal_write_super(void)
+{
+	jsuper.s.js_magic = JSUPER_MAGIC;
+	jsuper.s.js_start = jnl_head;
+	jsuper.s.js_seq = jnl_seq;
+	jsuper.s.js_sum = jsuper_sum(&jsuper.s);
+	ide_write(super->s_journal * BLKSECTS, &jsuper, BLKSECTS);
+}
+
+// Forget the open transaction.  Its blocks stay changed in the cache.
+static void
+journal_drop_open(void)
+{
+	uint32_t i;
+
+	for (i = 0; i < jnl_n; i++)
+		bit_clear(jnl_open, jhdr.h.jh_blocks[i]);
+	jnl_n = 0;
+	jnl_nreq = 0;
+}
+
+// Commit the open transaction.
+void
+journal_commit(void)
+{
+	uint32_t i, b;
+
+	if (!journal_enabled() || jnl_n == 0)
+		return;
+
+	// Data first, so committed metadata never points at stale data.
+	// Metadata goes home only from the log.  (Blocks in the open
+	// transaction or waiting for a checkpoint are all in jnl_meta.)
+	for (b = 1; b < super->s_nblocks; b++)
+		if (!bit_test(jnl_meta, b))
+			flush_block(diskaddr(b));
+
+	for (i = 0; i < jnl_n; i++)
+		ide_write(journal_sect(jnl_head + 1 + i),
+			  diskaddr(jhdr.h.jh_blocks[i]), BLKSECTS);
+	if (journal_crash == JOURNAL_CRASH_PRECOMMIT)
+		goto crash;
+	jhdr.h.jh_magic = JOURNAL_MAGIC;
+	jhdr.h.jh_seq = jnl_seq;
+	jhdr.h.jh_nblocks = jnl_n;
+	jhdr.h.jh_sum = journal_sum(&jhdr.h);
+	ide_write(journal_sect(jnl_head), &jhdr, BLKSECTS);
+
+	jnl_head = (jnl_head + 1 + jnl_n) % journal_logsize();
+	jnl_used += 1 + jnl_n;
+	jnl_seq++;
+	for (i = 0; i < jnl_n; i++)
+		bit_set(jnl_pending, jhdr.h.jh_blocks[i]);
+crash:
+	journal_crash = 0;
+	journal_drop_open();
+}
+
+// Write every committed block home and empty the log.  There must be
+// no open transaction, since the blocks are written from the cache.
+// Then free the blocks that were waiting for this.
+static void
+journal_checkpoint(void)
+{
+	uint32_t w, b, i, n;
+
+	assert(jnl_n == 0);
+	for (w = 0; w < JNL_NWORDS && w * 32 < super->s_nblocks; w++) {
+		if (!jnl_pending[w])
+			continue;
+		for (b = w * 32; b < (w + 1) * 32; b++)
+			if (bit_test(jnl_pending, b))
+				flush_block(diskaddr(b));
+		jnl_pending[w] = 0;
+	}
+	jnl_used = 0;
+	journal_write_super();
+
+	n = jnl_ndefer;
+	jnl_ndefer = 0;
+	for (i = 0; i < n; i++)
+		free_block(jnl_defer[i]);
+}
+
+// Commit, then write everything home.
+void
+journal_sync(void)
+{
+	if (!journal_enabled())
+		return;
+	journal_commit();
+	journal_checkpoint();
+	// Freeing the deferred blocks changed the bitmap.
+	if (jnl_n > 0) {
+		journal_commit();
+		journal_checkpoint();
+	}
+}
+
+// Blocks an operation asking journal_begin for n may journal in all.
+static uint32_t
+journal_opsize(uint32_t n)
+{
+	return n + (super->s_nblocks + BLKBITSIZE - 1) / BLKBITSIZE
+		+ JOURNAL_OPBLOCKS;
+}
+
+// Can journal_begin make room for n blocks?  Operations that would
+// touch more than one transaction holds must be split up or skipped.
+bool
+journal_fits(uint32_t n)
+{
+	return !journal_enabled() || journal_opsize(n) <= journal_max();
+}
+
+// Make room for an operation that will journal at most n blocks on top
+// of the bitmap and JOURNAL_OPBLOCKS others, committing or emptying the
+// log first if need be.  Must be called before the operation changes
+// anything, since the open transaction may be committed here.
+void
+journal_begin(uint32_t n)
+{
+	if (!journal_enabled())
+		return;
+	n = journal_opsize(n);
+	if (jnl_n + n > journal_max())
+		journal_commit();
+	if (jnl_used + 1 + jnl_n + n > journal_logsize()) {
+		journal_commit();
+		journal_checkpoint();
+	}
+	if (jnl_used + 1 + jnl_n + n > journal_logsize())
+		panic("journal: an operation needs %d blocks, the log has %d",
+		      n, journal_logsize() - 1);
+}
+
+// Make the block containing addr part of the open transaction.  The
+// caller must already have made its change to the block, and reserved
+// room for it with journal_begin.  Does nothing if the disk has no
+// journal.
+void
+journal_add(void *addr)
+{
+	uint32_t blockno = ((uint32_t)addr - DISKMAP) / BLKSIZE;
+
+	if (!journal_enabled())
+		return;
+	jnl_changed = 1;
+	bit_set(jnl_meta, blockno);
+	if (bit_test(jnl_open, blockno))
+		return;
+	if (jnl_n == journal_max()
+	    || jnl_used + 1 + jnl_n + 1 > journal_logsize())
+		panic("journal: transaction outgrew its reservation");
+	bit_set(jnl_open, blockno);
+	jhdr.h.jh_blocks[jnl_n++] = blockno;
+}
+
+// Write a changed metadata block out: through the journal if the disk
+// has one, otherwise in place right away.
+void
+meta_flush(void *addr)
+{
+	if (journal_enabled())
+		journal_add(addr);
+	else
+		flush_block(addr);
+}
+
+// Called by free_block.  Returns 1 if the journal will free blockno
+// itself, at the next checkpoint, because the log still holds its old
+// contents; otherwise blockno no longer holds metadata and the caller
+// frees it now.
+bool
+journal_free(uint32_t blockno)
+{
+	if (!journal_enabled())
+		return 0;
+	if (bit_test(jnl_open, blockno) || bit_test(jnl_pending, blockno)) {
+		if (jnl_ndefer == JNL_MAXDEFER)
+			panic("journal: too many blocks waiting to be freed");
+		jnl_defer[jnl_ndefer++] = blockno;
+		return 1;
+	}
+	bit_clear(jnl_meta, blockno);
+	return 0;
+}
+
+// Is there an open transaction?  The server commits it when idle.
+bool
+journal_pending(void)
+{
+	return jnl_n > 0;
+}
+
+// Called after each request.  Commits once enough requests have
+// changed metadata.
+void
+journal_request_done(void)
+{
+	if (jnl_changed) {
+		jnl_changed = 0;
+		jnl_nreq++;
+	}
+	if (jnl_nreq >= JOURNAL_GROUP)
+		journal_commit();
+}
+
+// Replay the committed transactions in the log, oldest first, and
+// empty it.  Anything in the cache that was not committed is lost, as
+// in a crash.  Returns the number of blocks replayed.
+int
+journal_recover(void)
+{
+	uint32_t i, b, n, pos, seq, used;
+
+	journal_drop_open();
+	jnl_changed = 0;
+	memset(jnl_pending, 0, sizeof(jnl_pending));
+	jnl_ndefer = 0;
+	if (!journal_enabled())
+		return 0;
+
+	ide_read(super->s_journal * BLKSECTS, &jsuper, BLKSECTS);
+	pos = seq = 0;
+	if (jsuper.s.js_magic == JSUPER_MAGIC
+	    && jsuper.s.js_sum == jsuper_sum(&jsuper.s)) {
+		pos = jsuper.s.js_start % journal_logsize();
+		seq = jsuper.s.js_seq;
+	}
+
+	for (n = used = 0; ; seq++) {
+		ide_read(journal_sect(pos), &jhdr, BLKSECTS);
+		if (jhdr.h.jh_magic != JOURNAL_MAGIC || jhdr.h.jh_seq != seq
+		    || jhdr.h.jh_nblocks > journal_max()
+		    || used + 1 + jhdr.h.jh_nblocks > journal_logsize()
+		    || jhdr.h.jh_sum != journal_sum(&jhdr.h))
+			break;
+		for (i = 0; i < jhdr.h.jh_nblocks; i++) {
+			b = jhdr.h.jh_blocks[i];
+			if (b == 0 || b >= super->s_nblocks)
+				panic("journal: bad block %d", b);
+			ide_read(journal_sect(pos + 1 + i), jblock, BLKSECTS);
+			ide_write(b * BLKSECTS, jblock, BLKSECTS);
+			// Drop the cached copy so it is re-read.  This
+			// includes the super block, which simply faults
+			// back in the next time it is used.
+			if (va_is_mapped(diskaddr(b)))
+				sys_page_unmap(0, diskaddr(b));
+		}
+		n += jhdr.h.jh_nblocks;
+		used += 1 + jhdr.h.jh_nblocks;
+		pos = (pos + 1 + jhdr.h.jh_nblocks) % journal_logsize();
+	}
+
+	jnl_head = pos;
+	jnl_seq = seq;
+	jnl_used = 0;
+	journal_write_super();
+	return n;
+}
+
+// Recover from the journal at mount time.
+void
+journal_init(void)
+{
+	int n;
+
+	if (!journal_enabled())
+		return;
+	if ((n = journal_recover()) > 0)
+		cprintf("journal: replayed %d blocks\n", n);
+}
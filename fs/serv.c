@@ -34,20 +34,79 @@ struct OpenFile {
 	struct File *o_file;	// mapped descriptor for open file
 	int o_mode;		// open mode
 	struct Fd *o_fd;	// Fd page
+	bool o_free;		// on the free list
+	struct OpenFile *o_next;	// next on the free list
 };
 
 // Max number of open files in the file system at once
-#define MAXOPEN		1024
+#define MAXOPEN		8192
 #define FILEVA		0xD0000000
 
-// initialize to force into data section
-struct OpenFile opentab[MAXOPEN] = {
-	{ 0, 0, 1, 0 }
+// Slots are handed out this many at a time from the untouched part of
+// opentab.  A reclaim pass stops once it has freed OPENFILE_BATCH
+// slots, and has to find a closed file in at least one of every
+// RECLAIM_MIN slots it looks at to be preferred over handing out more.
+// When the table is full and a whole pass finds nothing, opens fail
+// without another pass until RECLAIM_BACKOFF_NS have gone by.
+#define OPENFILE_BATCH	64
+#define RECLAIM_MIN	8
+#define RECLAIM_BACKOFF_NS	(10ULL * 1000 * 1000)
+
+struct OpenFile opentab[MAXOPEN];
+
+// Slots known to be free.  Clients close files by unmapping their Fd
+// page without telling us, so closed slots are found in batches by
+// openfile_reclaim rather than being freed one at a time.
+static struct OpenFile *openfile_freelist;
+// opentab[nused..] have never been used.
+static uint32_t nused;
+// Where the next reclaim pass starts, and the time before which
+// there's no point in starting one.
+static uint32_t reclaim_next;
+static uint64_t reclaim_after;
+
+// Partial last pages handed out by serve_map: a copy of the block with
+// everything past the requested length zeroed.  Every client mapping
+// the same range of a file gets the same page, until the file changes.
+struct Tail {
+	struct File *t_file;	// 0 if the slot is unused
+	uint32_t t_block;	// block number within the file
+	uint32_t t_len;		// bytes kept from the block
 };
 
+#define NTAIL		128
+#define TAILVA		(FILEVA + MAXOPEN * PGSIZE)
+
+static struct Tail tails[NTAIL];
+static uint32_t tail_next;
+
+// How long the server waits for another request before committing
+// the journal's open transaction.
+#define JOURNAL_IDLE_NS	(1000ULL * 1000 * 1000)
+
 // Virtual address at which to receive page mappings containing client requests.
 union Fsipc *fsreq = (union Fsipc *)0x0ffff000;
 
+// Put o on the free list.
+static void
+openfile_free(struct OpenFile *o)
+{
+	o->o_free = 1;
+	o->o_next = openfile_freelist;
+	openfile_freelist = o;
+}
+
+// Bring up to OPENFILE_BATCH never-used slots onto the free list.
+static void
+openfile_grow(void)
+{
+	uint32_t i, n;
+
+	n = MIN(MAXOPEN - nused, OPENFILE_BATCH);
+	for (i = 0; i < n; i++)
+		openfile_free(&opentab[nused++]);
+}
+
 void
 serve_init(void)
 {
@@ -58,29 +117,58 @@ serve_init(void)
 		opentab[i].o_fd = (struct Fd*) va;
 		va += PGSIZE;
 	}
+	openfile_grow();
+}
+
+// Refill the free list with slots whose Fd page only we still hold,
+// scanning on from where the last pass stopped.  If that turns up too
+// few compared to the length of the scan, bring more unused slots
+// into play; if there are none left either, hold off on scanning.
+static void
+openfile_reclaim(void)
+{
+	uint32_t n, nfreed;
+	struct OpenFile *o;
+
+	if (nused == MAXOPEN && time_ns() < reclaim_after)
+		return;
+	nfreed = 0;
+	for (n = 0; n < nused && nfreed < OPENFILE_BATCH; n++) {
+		o = &opentab[reclaim_next];
+		reclaim_next = (reclaim_next + 1) % nused;
+		if (!o->o_free && pageref(o->o_fd) <= 1) {
+			openfile_free(o);
+			nfreed++;
+		}
+	}
+	if (nfreed > 0 && nfreed * RECLAIM_MIN >= n)
+		return;
+	openfile_grow();
+	if (!openfile_freelist)
+		reclaim_after = time_ns() + RECLAIM_BACKOFF_NS;
 }
 
 // Allocate an open file.
 int
 openfile_alloc(struct OpenFile **o)
 {
-	int i, r;
-	
-	// Find an available open-file table entry
-	for (i = 0; i < MAXOPEN; i++) {
-		switch (pageref(opentab[i].o_fd)) {
-		case 0:
-			if ((r = sys_page_alloc(0, opentab[i].o_fd, PTE_P|PTE_U|PTE_W)) < 0)
-				return r;
-			/* fall through */
-		case 1:
-			opentab[i].o_fileid += MAXOPEN;
-			*o = &opentab[i];
-			memset(opentab[i].o_fd, 0, PGSIZE);
-			return (*o)->o_fileid;
-		}
-	}
-	return -E_MAX_OPEN;
+	int r;
+	struct OpenFile *of;
+
+	if (!openfile_freelist)
+		openfile_reclaim();
+	if (!(of = openfile_freelist))
+		return -E_MAX_OPEN;
+
+	if (pageref(of->o_fd) == 0
+	    && (r = sys_page_alloc(0, of->o_fd, PTE_P|PTE_U|PTE_W)) < 0)
+		return r;
+	openfile_freelist = of->o_next;
+	of->o_free = 0;
+	of->o_fileid += MAXOPEN;
+	memset(of->o_fd, 0, PGSIZE);
+	*o = of;
+	return of->o_fileid;
 }
 
 // Look up an open file for envid.
@@ -98,6 +186,51 @@ openfile_lookup(envid_t envid, uint32_t fileid, struct OpenFile **po)
 	return 0;
 }
 
+// Find or make the page holding the first len bytes of block filebno
+// of f, followed by zeroes.  Returns 0 and sets *pg, or < 0 on error.
+static int
+tail_get(struct File *f, uint32_t filebno, uint32_t len, char **pg)
+{
+	struct Tail *t;
+	char *blk, *va;
+	int i, r;
+
+	for (i = 0; i < NTAIL; i++) {
+		t = &tails[i];
+		if (t->t_file == f && t->t_block == filebno && t->t_len == len) {
+			*pg = (char *) (TAILVA + i * PGSIZE);
+			return 0;
+		}
+	}
+
+	if ((r = file_get_block(f, filebno, &blk)) < 0)
+		return r;
+	// Clients keep any mapping they have of the page replaced here.
+	i = tail_next++ % NTAIL;
+	va = (char *) (TAILVA + i * PGSIZE);
+	if ((r = sys_page_alloc(0, va, PTE_P|PTE_U|PTE_W)) < 0)
+		return r;
+	memmove(va, blk, len);
+	tails[i].t_file = f;
+	tails[i].t_block = filebno;
+	tails[i].t_len = len;
+	*pg = va;
+	return 0;
+}
+
+// Forget the tail pages of f, which is about to change.
+static void
+tail_drop(struct File *f)
+{
+	int i;
+
+	for (i = 0; i < NTAIL; i++)
+		if (tails[i].t_file == f) {
+			tails[i].t_file = 0;
+			sys_page_unmap(0, (void *) (TAILVA + i * PGSIZE));
+		}
+}
+
 // Open req->req_path in mode req->req_omode, storing the Fd page and
 // permissions to return to the calling environment in *pg_store and
 // *perm_store respectively.
@@ -133,29 +266,30 @@ serve_open(envid_t envid, struct Fsreq_open *req,
 				goto try_open;
 			if (debug)
 				cprintf("file_create failed: %e", r);
-			return r;
+			goto fail;
 		}
 	} else {
 try_open:
 		if ((r = file_open(path, &f)) < 0) {
 			if (debug)
 				cprintf("file_open failed: %e", r);
-			return r;
+			goto fail;
 		}
 	}
 
 	// Truncate
 	if (req->req_omode & O_TRUNC) {
+		tail_drop(f);
 		if ((r = file_set_size(f, 0)) < 0) {
 			if (debug)
 				cprintf("file_set_size failed: %e", r);
-			return r;
+			goto fail;
 		}
 	}
 	if ((r = file_open(path, &f)) < 0) {
 		if (debug)
 			cprintf("file_open failed: %e", r);
-		return r;
+		goto fail;
 	}
 
 	// Save the file pointer
@@ -176,6 +310,10 @@ try_open:
 	*perm_store = PTE_P|PTE_U|PTE_W|PTE_SHARE;
 
 	return 0;
+
+fail:
+	openfile_free(o);
+	return r;
 }
 
 // Set the size of req->req_fileid to req->req_size bytes, truncating
@@ -199,6 +337,7 @@ serve_set_size(envid_t envid, struct Fsreq_set_size *req)
 
 	// Second, call the relevant file system function (from fs/fs.c).
 	// On failure, return the error code to the client.
+	tail_drop(o->o_file);
 	return file_set_size(o->o_file, req->req_size);
 }
 
@@ -249,6 +388,7 @@ serve_write(envid_t envid, struct Fsreq_write *req)
 	{
 		return r;
 	}
+	tail_drop(o->o_file);
 	int writen = file_write(o->o_file, req->req_buf, req->req_n, o->o_fd->fd_offset);
 	if(writen < 0)
 	{
@@ -304,6 +444,81 @@ serve_sync(envid_t envid, union Fsipc *req)
 	return 0;
 }
 
+// Report free-space and file fragmentation, and name cache statistics,
+// in ipc->statfsRet.
+int
+serve_statfs(envid_t envid, union Fsipc *ipc)
+{
+	if (debug)
+		cprintf("serve_statfs %08x\n", envid);
+
+	fs_statfs(&ipc->statfsRet);
+	return 0;
+}
+
+// Map the pages holding req->req_n bytes of req_fileid, starting at
+// the page-aligned req_offset, from the block cache into req_envid at
+// req_va.  Nothing is copied: the pages are read-only, or copy-on-write
+// if req_perm has PTE_COW.  The client keeps the contents it mapped: a
+// later write to a block copies it first (see bc_unshare), and a freed
+// block leaves the cache (see bc_drop), so a running program never
+// sees its binary change or another file's data.  A partial last
+// page reads as zero past req_n; it is a copy shared by everyone who
+// maps that range (see tail_get).  Clients may only name themselves or
+// their own children.  Returns 0 or < 0 on error.
+int
+serve_map(envid_t envid, struct Fsreq_map *req)
+{
+	const volatile struct Env *e;
+	struct OpenFile *o;
+	envid_t dst;
+	uint32_t i, n, npages;
+	char *blk;
+	int perm, r;
+
+	if (debug)
+		cprintf("serve_map %08x %08x %08x %08x -> %08x:%08x\n", envid,
+			req->req_fileid, req->req_offset, req->req_n,
+			req->req_envid, req->req_va);
+
+	if ((r = openfile_lookup(envid, req->req_fileid, &o)) < 0)
+		return r;
+	npages = ROUNDUP(req->req_n, PGSIZE) / PGSIZE;
+	if (req->req_offset < 0 || req->req_offset % BLKSIZE
+	    || req->req_offset > o->o_file->f_size
+	    || req->req_n > o->o_file->f_size - req->req_offset
+	    || req->req_va % PGSIZE || req->req_va >= UTOP
+	    || npages > (UTOP - req->req_va) / PGSIZE)
+		return -E_INVAL;
+
+	dst = req->req_envid ? req->req_envid : envid;
+	if (dst != envid) {
+		if (ENVX(dst) >= envs_mapped())
+			return -E_BAD_ENV;
+		e = &envs[ENVX(dst)];
+		if (e->env_id != dst || e->env_parent_id != envid)
+			return -E_BAD_ENV;
+	}
+
+	perm = PTE_P | PTE_U | (req->req_perm & PTE_COW);
+	for (i = 0; i < npages; i++) {
+		n = req->req_n - i * PGSIZE;
+		if (n < PGSIZE)
+			r = tail_get(o->o_file, req->req_offset / BLKSIZE + i, n, &blk);
+		else
+			r = file_get_block(o->o_file, req->req_offset / BLKSIZE + i, &blk);
+		if (r < 0)
+			return r;
+		// Fault the block in: only present pages can be mapped.
+		if (!va_is_mapped(blk))
+			*(volatile char *) blk;
+		if ((r = sys_page_map(0, blk, dst,
+				      (void *) (req->req_va + i * PGSIZE), perm)) < 0)
+			return r;
+	}
+	return 0;
+}
+
 typedef int (*fshandler)(envid_t envid, union Fsipc *req);
 
 fshandler handlers[] = {
@@ -314,7 +529,9 @@ fshandler handlers[] = {
 	[FSREQ_FLUSH] =		(fshandler)serve_flush,
 	[FSREQ_WRITE] =		(fshandler)serve_write,
 	[FSREQ_SET_SIZE] =	(fshandler)serve_set_size,
-	[FSREQ_SYNC] =		serve_sync
+	[FSREQ_SYNC] =		serve_sync,
+	[FSREQ_STATFS] =	serve_statfs,
+	[FSREQ_MAP] =		(fshandler)serve_map
 };
 
 void
@@ -326,7 +543,14 @@ serve(void)
 
 	while (1) {
 		perm = 0;
-		req = ipc_recv((int32_t *) &whom, fsreq, &perm);
+		// Commit metadata changes once things go quiet, rather than
+		// leaving them for the next group commit.
+		req = ipc_recv_timeout((int32_t *) &whom, fsreq, &perm,
+				       journal_pending() ? JOURNAL_IDLE_NS : 0);
+		if (whom == 0 && req == -E_TIMEOUT) {
+			journal_commit();
+			continue;
+		}
 		if (debug)
 			cprintf("fs req %d from %08x [page %08x: %s]\n",
 				req, whom, uvpt[PGNUM(fsreq)], fsreq);
@@ -339,6 +563,7 @@ serve(void)
 		}
 
 		pg = NULL;
+		journal_begin(0);
 		if (req == FSREQ_OPEN) {
 			r = serve_open(whom, (struct Fsreq_open*)fsreq, &pg, &perm);
 		} else if (req < ARRAY_SIZE(handlers) && handlers[req]) {
@@ -349,6 +574,7 @@ serve(void)
 		}
 		ipc_send(whom, r, pg, perm);
 		sys_page_unmap(0, fsreq);
+		journal_request_done();
 	}
 }
 
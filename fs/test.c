@@ -9,7 +9,7 @@ void
 fs_test(void)
 {
 	struct File *f;
-	int r;
+	int r, r2, r3;
 	char *blk;
 	uint32_t *bits;
 
@@ -27,6 +27,19 @@ fs_test(void)
 	assert(!(bitmap[r/32] & (1 << (r%32))));
 	cprintf("alloc_block is good\n");
 
+	// a goal that is free should be handed out as-is,
+	// and a taken goal should yield the next free block after it
+	if ((r2 = alloc_block_near(r + 1)) < 0)
+		panic("alloc_block_near: %e", r2);
+	assert(r2 == r + 1 || !(bits[(r + 1)/32] & (1 << ((r + 1)%32))));
+	if ((r3 = alloc_block_near(r2)) < 0)
+		panic("alloc_block_near 2: %e", r3);
+	assert(r3 > r2);
+	free_block(r2);
+	free_block(r3);
+	meta_flush(bitmap);
+	cprintf("alloc_block_near is good\n");
+
 	if ((r = file_open("/not-found", &f)) < 0 && r != -E_NOT_FOUND)
 		panic("file_open /not-found: %e", r);
 	else if (r == 0)
@@ -50,11 +63,14 @@ fs_test(void)
 	if ((r = file_set_size(f, 0)) < 0)
 		panic("file_set_size: %e", r);
 	assert(f->f_direct[0] == 0);
+	// metadata reaches its home block when the journal checkpoints
+	journal_sync();
 	assert(!(uvpt[PGNUM(f)] & PTE_D));
 	cprintf("file_truncate is good\n");
 
 	if ((r = file_set_size(f, strlen(msg))) < 0)
 		panic("file_set_size 2: %e", r);
+	journal_sync();
 	assert(!(uvpt[PGNUM(f)] & PTE_D));
 	if ((r = file_get_block(f, 0, &blk)) < 0)
 		panic("file_get_block 2: %e", r);
@@ -62,6 +78,50 @@ fs_test(void)
 	assert((uvpt[PGNUM(blk)] & PTE_D));
 	file_flush(f);
 	assert(!(uvpt[PGNUM(blk)] & PTE_D));
+	journal_sync();
 	assert(!(uvpt[PGNUM(f)] & PTE_D));
 	cprintf("file rewrite is good\n");
+
+	if (!super->s_journal)
+		return;
+	// Crash with a block's new contents committed to the journal but
+	// not yet written home: recovery must write them home.
+	if ((r = alloc_block()) < 0)
+		panic("alloc_block 2: %e", r);
+	journal_sync();
+	blk = diskaddr(r);
+	strcpy(blk, "journal old");
+	flush_block(blk);
+	strcpy(blk, "journal new");
+	journal_add(blk);
+	journal_commit();
+	sys_page_unmap(0, blk);
+	assert(strcmp(blk, "journal old") == 0);
+	assert(journal_recover() == 1);
+	assert(strcmp(blk, "journal new") == 0);
+
+	// Two commits not yet checkpointed: both replay, in order.
+	strcpy(blk, "journal one");
+	journal_add(blk);
+	journal_commit();
+	strcpy(blk, "journal two");
+	journal_add(blk);
+	journal_commit();
+	sys_page_unmap(0, blk);
+	assert(strcmp(blk, "journal new") == 0);
+	assert(journal_recover() == 2);
+	assert(strcmp(blk, "journal two") == 0);
+
+	// Crash before the commit record: recovery must do nothing.
+	strcpy(blk, "journal torn");
+	journal_add(blk);
+	journal_crash = JOURNAL_CRASH_PRECOMMIT;
+	journal_commit();
+	sys_page_unmap(0, blk);
+	assert(journal_recover() == 0);
+	assert(strcmp(blk, "journal two") == 0);
+
+	free_block(r);
+	journal_sync();
+	cprintf("journal recovery is good\n");
 }
@@ -9,25 +9,43 @@
 
 typedef int32_t envid_t;
 
-// An environment ID 'envid_t' has three parts:
+// A queue of environments sleeping until some event happens; see
+// kern/waitq.c.  A zeroed WaitQueue is empty.
+struct WaitQueue {
+	struct Env *wq_head;		// Oldest sleeper first
+};
+
+// A pending timeout on the kernel's timer wheel; see kern/timer.c.
+struct Timer {
+	uint64_t t_expire;		// Deadline, in clock_ns() time
+	struct Timer *t_next;		// Next timer in the same slot
+	struct Timer **t_pprev;		// Link pointing here, or null if idle
+	void (*t_fn)(struct Timer *t);	// Called on expiry
+};
+
+// An environment ID 'envid_t' has four parts:
 //
-// +1+---------------21-----------------+--------10--------+
-// |0|          Uniqueifier             |   Environment    |
-// | |                                  |      Index       |
-// +------------------------------------+------------------+
-//                                       \--- ENVX(eid) --/
+// +1+--3--+-------------16-------------+--------12--------+
+// |0| Env |        Uniqueifier         |   Environment    |
+// | |Index|                            |   Index (low)    |
+// +-------+----------------------------+------------------+
 //
-// The environment index ENVX(eid) equals the environment's index in the
-// 'envs[]' array.  The uniqueifier distinguishes environments that were
-// created at different times, but share the same environment index.
+// The environment index ENVX(eid), the two index parts put together,
+// equals the environment's index in the 'envs[]' array.  The
+// uniqueifier distinguishes environments that were created at
+// different times, but share the same environment index.  The high
+// index bits sit above the uniqueifier so that the first 4096
+// environments have the same IDs they had when NENV was smaller.
 //
 // All real environments are greater than 0 (so the sign bit is zero).
 // envid_ts less than 0 signify errors.  The envid_t == 0 is special, and
 // stands for the current environment.
 
-#define LOG2NENV		10
+#define LOG2NENV		15
 #define NENV			(1 << LOG2NENV)
-#define ENVX(envid)		((envid) & (NENV - 1))
+#define ENVX(envid)		(((envid) & 0xFFF) | (((envid) >> 16) & 0x7000))
+// The index bits of an env_id for envs[envx]
+#define ENVX_ID(envx)		(((envx) & 0xFFF) | (((envx) & 0x7000) << 16))
 
 // Values of env_status in struct Env
 enum {
@@ -38,21 +56,46 @@ enum {
 	ENV_NOT_RUNNABLE
 };
 
+// Exit status of an environment that was destroyed rather than exiting
+#define ENV_EXIT_KILLED		(-1)
+
+// Scheduling priorities, as for Unix nice: lower gets more of the CPU
+#define ENV_PRIO_MIN		(-20)
+#define ENV_PRIO_MAX		19
+#define ENV_PRIO_FS		(-5)	// Default for the file server
+
 // Special environment types
 enum EnvType {
 	ENV_TYPE_USER = 0,
 	ENV_TYPE_FS,		// File system server
+	ENV_NTYPES
 };
 
+// Each Env starts on a cache line of its own, so CPUs working on
+// neighbouring environments don't fight over lines.  The fields that
+// sched_yield and sched_halt look at for every environment come first
+// and share that line, so a scan of envs[] reads one line per Env.
 struct Env {
-	struct Trapframe env_tf;	// Saved registers
-	struct Env *env_link;		// Next free Env
-	envid_t env_id;			// Unique environment identifier
-	envid_t env_parent_id;		// env_id of this env's parent
-	enum EnvType env_type;		// Indicates special system environments
+	// Scanned by the scheduler (see kern/sched.c)
 	unsigned env_status;		// Status of the environment
+	uint32_t env_affinity;		// CPUs it may run on, a bitmask by cpunum
+	uint64_t env_vruntime;		// Cycles run, scaled by priority
 	uint32_t env_runs;		// Number of times environment has run
 	int env_cpunum;			// The CPU that the env is running on
+	envid_t env_id;			// Unique environment identifier
+	enum EnvType env_type;		// Indicates special system environments
+	struct Timer env_timer;		// Ends a sleep early (env_timeout)
+
+	struct Trapframe env_tf;	// Saved registers
+	envid_t env_parent_id;		// env_id of this env's parent
+
+	// Scheduling
+	int env_priority;		// ENV_PRIO_MIN .. ENV_PRIO_MAX
+	uint64_t env_runtime;		// Cycles run, in total
+	uint32_t env_migrations;	// Times it ran on a different CPU than before
+	uint64_t env_utime;		// Cycles of env_runtime spent in user mode
+	uint64_t env_ipctime;		// Cycles spent blocked in sys_ipc_recv
+	uint64_t env_ipc_tsc;		// When the current sys_ipc_recv blocked
 
 	// Address space
 	pde_t *env_pgdir;		// Kernel virtual address of page dir
@@ -66,6 +109,35 @@ struct Env {
 	uint32_t env_ipc_value;		// Data value sent to us
 	envid_t env_ipc_from;		// envid of the sender
 	int env_ipc_perm;		// Perm of page mapping received
+
+	// Sleeping (see kern/waitq.c)
+	struct WaitQueue *env_waitq;	// Queue the env sleeps on, or null
+	struct Env *env_wait_next;	// Next env on the same queue
+	physaddr_t env_futex_pa;	// Futex word slept on, or 0 if none
+
+	// Exit status and waiting for exit (see sys_wait)
+	int env_exit_status;		// Set by sys_env_exit
+	bool env_zombie;		// Freed, but parent hasn't waited yet
+	int env_nzombies;		// Zombie children
+	struct WaitQueue env_exitq;	// Envs waiting for this one to exit
+	struct WaitQueue env_childq;	// This env, waiting for any child
+} __attribute__((aligned(CACHELINE)));
+
+// What sys_env_stat reports about an environment
+struct EnvStat {
+	envid_t es_id;
+	envid_t es_parent_id;
+	unsigned es_status;
+	int es_priority;
+	int es_cpunum;			// The CPU it last ran on
+	uint32_t es_runs;
+	uint32_t es_migrations;
+	uint64_t es_user_ns;		// Running in user mode
+	uint64_t es_kernel_ns;		// In the kernel on its behalf
+	uint64_t es_ipc_ns;		// Blocked in sys_ipc_recv
+	uint32_t es_pages;		// User pages mapped below UTOP
+	uint32_t es_shared;		// ... of which someone else maps too
+	uint32_t es_ptables;		// Page directory and page tables
 };
 
 #endif // !JOS_INC_ENV_H
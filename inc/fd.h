@@ -27,6 +27,16 @@ struct FdFile {
 	int id;
 };
 
+// Console input already read from the kernel but not yet returned.
+// Kept in the Fd so that it is shared along with the descriptor.
+#define FDCONS_BUFSIZ	256
+
+struct FdCons {
+	uint32_t rpos;		// Next character to return
+	uint32_t n;		// Characters in buf
+	char buf[FDCONS_BUFSIZ];
+};
+
 struct Fd {
 	int fd_dev_id;
 	off_t fd_offset;
@@ -34,6 +44,8 @@ struct Fd {
 	union {
 		// File server files
 		struct FdFile fd_file;
+		// The console
+		struct FdCons fd_cons;
 	};
 };
 
@@ -36,9 +36,15 @@ struct File {
 	uint32_t f_direct[NDIRECT];	// direct blocks
 	uint32_t f_indirect;		// indirect block
 
+	// Directory hash index; only meaningful when the super block has
+	// FS_FEAT_DIRINDEX set.  See dir_lookup in fs/fs.c.
+	uint32_t f_dirhash;		// dir: block of hash buckets, or 0
+	uint32_t f_dirfree;		// dir: no free slot below this one
+	uint32_t f_hnext;		// entry: next slot in hash chain, plus 1
+
 	// Pad out to 256 bytes; must do arithmetic in case we're compiling
 	// fsformat on a 64-bit machine.
-	uint8_t f_pad[256 - MAXNAMELEN - 8 - 4*NDIRECT - 4];
+	uint8_t f_pad[256 - MAXNAMELEN - 8 - 4*NDIRECT - 4 - 12];
 } __attribute__((packed));	// required only on some 64-bit machines
 
 // An inode block contains exactly BLKFILES 'struct File's
@@ -48,6 +54,21 @@ struct File {
 #define FTYPE_REG	0	// Regular file
 #define FTYPE_DIR	1	// Directory
 
+// A directory's hash index is one block of chain heads, each holding a
+// slot number plus 1 (0 ends a chain).
+#define DIR_NBUCKETS	(BLKSIZE / 4)
+
+// FNV-1a hash of a file name, used to pick its directory hash bucket.
+static inline uint32_t
+dir_hash(const char *name)
+{
+	uint32_t h = 2166136261U;
+
+	while (*name)
+		h = (h ^ (uint8_t) *name++) * 16777619U;
+	return h;
+}
+
 
 // File system super-block (both in-memory and on-disk)
 
@@ -57,8 +78,14 @@ struct Super {
 	uint32_t s_magic;		// Magic number: FS_MAGIC
 	uint32_t s_nblocks;		// Total number of blocks on disk
 	struct File s_root;		// Root directory node
+	uint32_t s_features;		// FS_FEAT_* flags; 0 on old images
+	uint32_t s_journal;		// First block of the journal, or 0
+	uint32_t s_njournal;		// Blocks in the journal
 };
 
+// Feature flags in s_features
+#define FS_FEAT_DIRINDEX	0x1	// directories may carry a hash index
+
 // Definitions for requests from clients to file system
 enum {
 	FSREQ_OPEN = 1,
@@ -70,7 +97,11 @@ enum {
 	FSREQ_STAT,
 	FSREQ_FLUSH,
 	FSREQ_REMOVE,
-	FSREQ_SYNC
+	FSREQ_SYNC,
+	// Statfs returns a Fsret_statfs on the request page
+	FSREQ_STATFS,
+	// Map shares block cache pages with the caller or its child
+	FSREQ_MAP
 };
 
 union Fsipc {
@@ -108,6 +139,25 @@ union Fsipc {
 	struct Fsreq_remove {
 		char req_path[MAXPATHLEN];
 	} remove;
+	struct Fsret_statfs {
+		uint32_t ret_nblocks;		// blocks on the disk
+		uint32_t ret_nfree;		// free blocks
+		uint32_t ret_nfreeext;		// runs of contiguous free blocks
+		uint32_t ret_maxfreeext;	// longest free run, in blocks
+		uint32_t ret_nfiles;		// regular files in the root
+		uint32_t ret_nfileext;		// extents making up those files
+		uint32_t ret_dchits;		// name cache hits
+		uint32_t ret_dcneghits;		// hits on names known to be absent
+		uint32_t ret_dcmisses;		// lookups that searched a directory
+	} statfsRet;
+	struct Fsreq_map {
+		int req_fileid;
+		off_t req_offset;	// page-aligned
+		size_t req_n;
+		int32_t req_envid;	// 0 for the caller
+		uintptr_t req_va;
+		int req_perm;		// PTE_COW, or 0 for read-only
+	} map;
 
 	// Ensure Fsipc is one page
 	char _pad[PGSIZE];
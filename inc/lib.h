@@ -20,6 +20,9 @@
 #include <inc/fs.h>
 #include <inc/fd.h>
 #include <inc/args.h>
+#include <inc/stats.h>
+#include <inc/prof.h>
+#include <inc/time.h>
 
 #define USED(x)		(void)(x)
 
@@ -31,9 +34,11 @@ extern const char *binaryname;
 extern const volatile struct Env *thisenv;
 extern const volatile struct Env envs[NENV];
 extern const volatile struct PageInfo pages[];
+extern const volatile struct VTime vtime;
 
 // exit.c
 void	exit(void);
+void	exit_status(int status);
 
 // pgfault.c
 void	set_pgfault_handler(void (*handler)(struct UTrapframe *utf));
@@ -57,7 +62,28 @@ int	sys_page_map(envid_t src_env, void *src_pg,
 int	sys_page_unmap(envid_t env, void *pg);
 int	sys_ipc_try_send(envid_t to_env, uint32_t value, void *pg, int perm);
 int	sys_ipc_recv(void *rcv_pg);
-int sys_execv(void *elf_buf, uint32_t elf_size, const char **argv);
+int	sys_ipc_recv_timeout(void *rcv_pg, uint64_t ns);
+int sys_execv(void *image, uint32_t size, const char **argv);
+int	sys_futex_wait(const volatile uint32_t *addr, uint32_t val, int pgref);
+int	sys_futex_wait_timeout(const volatile uint32_t *addr, uint32_t val,
+			       int pgref, uint64_t ns);
+int	sys_futex_wake(const volatile uint32_t *addr, int n);
+int	sys_idle_cycles(uint64_t *cycles);
+void	sys_env_exit(int status);
+int	sys_wait(envid_t envid, int *status);
+envid_t	sys_wait_any(int *status);
+int	sys_cread(char *buf, size_t n);
+int	sys_trace_map(void *va);
+int	sys_stats(int cpu, struct Stats *st);
+int	sys_prof_ctl(uint32_t period);
+int	sys_prof_read(struct ProfSample *buf, int n, uint32_t *lost);
+int	sys_ksym(uintptr_t eip, char *name, size_t len);
+int	sys_time_ns(uint64_t *ns);
+int	sys_sleep_ns(uint64_t ns);
+int	sys_env_set_priority(envid_t envid, int prio);
+int	sys_env_set_affinity(envid_t envid, uint32_t mask);
+int	sys_env_stat(envid_t envid, struct EnvStat *st);
+int	sys_pages_free(void);
 
 // This must be inlined.  Exercise for reader: why?
 static inline envid_t __attribute__((always_inline))
@@ -73,7 +99,10 @@ sys_exofork(void)
 // ipc.c
 void	ipc_send(envid_t to_env, uint32_t value, void *pg, int perm);
 int32_t ipc_recv(envid_t *from_env_store, void *pg, int *perm_store);
+int32_t ipc_recv_timeout(envid_t *from_env_store, void *pg, int *perm_store,
+			 uint64_t ns);
 envid_t	ipc_find_env(enum EnvType type);
+int	envs_mapped(void);
 
 // fork.c
 #define	PTE_SHARE	0x400
@@ -96,6 +125,8 @@ int	open(const char *path, int mode);
 int	ftruncate(int fd, off_t size);
 int	remove(const char *path);
 int	sync(void);
+int	statfs(struct Fsret_statfs *st);
+int	file_map(int fd, off_t offset, size_t n, envid_t envid, void *va, int perm);
 
 // pageref.c
 int	pageref(void *addr);
@@ -117,6 +148,11 @@ int	pipeisclosed(int pipefd);
 
 // wait.c
 void	wait(envid_t env);
+int	wait_status(envid_t env, int *status);
+envid_t	wait_any(int *status);
+
+// time.c
+uint64_t time_ns(void);
 
 // exec.c
 int execl(const char *program, const char *arg0, ...);
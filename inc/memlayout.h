@@ -50,14 +50,16 @@
  *    UVPT      ---->  +------------------------------+ 0xef400000
  *                     |          RO PAGES            | R-/R-  PTSIZE
  *    UPAGES    ---->  +------------------------------+ 0xef000000
- *                     |           RO ENVS            | R-/R-  PTSIZE
- * UTOP,UENVS ------>  +------------------------------+ 0xeec00000
+ *                     |   RO ENVS (as far as used)   | R-/R-  ENVSSIZE
+ *    UENVS     ---->  +------------------------------+ 0xee400000
+ *                     |  ENVS, kernel's writable map | RW/--  ENVSSIZE
+ * UTOP,KENVS ------>  +------------------------------+ 0xed800000
  * UXSTACKTOP -/       |     User Exception Stack     | RW/RW  PGSIZE
- *                     +------------------------------+ 0xeebff000
+ *                     +------------------------------+ 0xed7ff000
  *                     |       Empty Memory (*)       | --/--  PGSIZE
- *    USTACKTOP  --->  +------------------------------+ 0xeebfe000
+ *    USTACKTOP  --->  +------------------------------+ 0xed7fe000
  *                     |      Normal User Stack       | RW/RW  PGSIZE
- *                     +------------------------------+ 0xeebfd000
+ *                     +------------------------------+ 0xed7fd000
  *                     |                              |
  *                     |                              |
  *                     ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -112,15 +114,23 @@
 #define UVPT		(ULIM - PTSIZE)
 // Read-only copies of the Page structures
 #define UPAGES		(UVPT - PTSIZE)
+// Room for the envs[] array, which is mapped a page at a time as it
+// grows (see env_alloc)
+#define ENVSSIZE	(3*PTSIZE)
 // Read-only copies of the global env structures
-#define UENVS		(UPAGES - PTSIZE)
+#define UENVS		(UPAGES - ENVSSIZE)
+// Read-only clock calibration (struct VTime), in the last page of the
+// UENVS region
+#define UVTIME		(UPAGES - PGSIZE)
+// The same env pages again, writable by the kernel only
+#define KENVS		(UENVS - ENVSSIZE)
 
 /*
  * Top of user VM. User can manipulate VA from UTOP-1 and down!
  */
 
 // Top of user-accessible VM
-#define UTOP		UENVS
+#define UTOP		KENVS
 // Top of one-page user exception stack
 #define UXSTACKTOP	UTOP
 // Next page left invalid to guard against exception stack overflow; then:
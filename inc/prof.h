@@ -0,0 +1,38 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_INC_PROF_H
+#define JOS_INC_PROF_H
+
+#include <inc/types.h>
+#include <inc/env.h>
+
+// Sampling profiler; see kern/prof.c.
+
+// How samples are taken, as returned by sys_prof_ctl.
+enum {
+	PROF_OFF = 0,
+	PROF_PMC,		// cycle counter overflow NMIs: sees everything
+	PROF_TIMER,		// LAPIC timer: sees user mode only
+};
+
+// Where a sample landed.
+enum {
+	PROF_USER = 0,
+	PROF_KERNEL,
+	PROF_IDLE,
+};
+
+// Sampling periods are in cycles for PROF_PMC and in LAPIC timer ticks
+// for PROF_TIMER.
+#define PROF_MINPERIOD	10000
+#define PROF_MAXPERIOD	0x7FFFFFFF
+
+struct ProfSample {
+	uintptr_t ps_eip;
+	envid_t ps_envid;		// Environment running, or 0
+	uint8_t ps_cpu;
+	uint8_t ps_mode;		// PROF_USER etc.
+	uint16_t ps_pad;
+};
+
+#endif /* !JOS_INC_PROF_H */
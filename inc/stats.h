@@ -0,0 +1,32 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_INC_STATS_H
+#define JOS_INC_STATS_H
+
+#include <inc/types.h>
+#include <inc/syscall.h>
+
+// Kernel latency histograms, as returned by sys_stats.  Each trap is
+// timed from kernel entry until the CPU next returns to user mode or
+// halts, by TSC, and counted under its trap vector and, for system
+// calls, its system call number.
+
+// Bucket b counts latencies in [2^b, 2^(b+1)) cycles (bucket 0 also
+// counts 0).
+#define STATS_NBUCKETS	32
+
+// Trap vectors with their own histogram; higher ones share the last.
+#define STATS_NTRAPS	64
+
+struct Hist {
+	uint64_t h_cycles;		// Total cycles
+	uint32_t h_count;		// Number of samples
+	uint32_t h_bucket[STATS_NBUCKETS];
+};
+
+struct Stats {
+	struct Hist st_syscall[NSYSCALLS];
+	struct Hist st_trap[STATS_NTRAPS];
+};
+
+#endif /* !JOS_INC_STATS_H */
@@ -18,6 +18,24 @@ enum {
 	SYS_ipc_try_send,
 	SYS_ipc_recv,
 	SYS_execv,
+	SYS_futex_wait,
+	SYS_futex_wake,
+	SYS_idle_cycles,
+	SYS_env_exit,
+	SYS_wait,
+	SYS_wait_any,
+	SYS_cread,
+	SYS_trace_map,
+	SYS_stats,
+	SYS_prof_ctl,
+	SYS_prof_read,
+	SYS_ksym,
+	SYS_time_ns,
+	SYS_sleep_ns,
+	SYS_env_set_priority,
+	SYS_env_set_affinity,
+	SYS_env_stat,
+	SYS_pages_free,
 	NSYSCALLS
 };
 
@@ -0,0 +1,38 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_INC_TIME_H
+#define JOS_INC_TIME_H
+
+#include <inc/types.h>
+
+// The kernel's clock calibration, mapped read-only at UVTIME in every
+// environment so user code can turn TSC readings into nanoseconds
+// without a system call.  Filled in once at boot by clock_init in
+// kern/kclock.c; all zero before that.
+struct VTime {
+	uint64_t vt_tsc_base;		// TSC at time 0 (calibration)
+	uint64_t vt_tsc_hz;		// TSC ticks per second
+	uint32_t vt_mult;		// ns = (tsc - base) * vt_mult >> vt_shift
+	uint32_t vt_shift;
+	uint32_t vt_lapic_hz;		// LAPIC timer ticks per second
+};
+
+// Nanoseconds in d TSC ticks.  Multiplies the low and high halves
+// separately to stay within 64 bits.
+static inline uint64_t
+vtime_cycles2ns(const volatile struct VTime *vt, uint64_t d)
+{
+	uint32_t lo = d, hi = d >> 32;
+
+	return ((uint64_t) lo * vt->vt_mult >> vt->vt_shift)
+		+ ((uint64_t) hi * vt->vt_mult << (32 - vt->vt_shift));
+}
+
+// Nanoseconds since calibration at TSC reading tsc.
+static inline uint64_t
+vtime_ns(const volatile struct VTime *vt, uint64_t tsc)
+{
+	return vtime_cycles2ns(vt, tsc - vt->vt_tsc_base);
+}
+
+#endif /* !JOS_INC_TIME_H */
@@ -0,0 +1,48 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_INC_TRACE_H
+#define JOS_INC_TRACE_H
+
+#include <inc/types.h>
+#include <inc/mmu.h>
+
+// Kernel event tracing.  Each CPU appends fixed-size events to its own
+// ring; sys_trace_map maps the rings read-only into a user environment.
+// The writer is the only one touching its ring, so it takes no lock:
+// it fills in event tb_head % TRACE_NEVENTS and then bumps tb_head.
+// A reader copies an event with index i < tb_head, then checks that
+// tb_head is still below i + TRACE_NEVENTS, which means the event
+// wasn't being overwritten while it was copied.
+
+#define TRACE_NPAGES	16			// Pages per CPU
+#define TRACE_BUFSIZE	(TRACE_NPAGES * PGSIZE)
+
+// Event types, and what their arguments are
+enum {
+	TRACE_TRAP = 1,		// trapno, eip, err
+	TRACE_SYSCALL,		// syscall number, cycles, return value
+	TRACE_RUN,		// envid switched to, envid switched from
+	TRACE_PGFAULT,		// fault va, eip, err
+	TRACE_IPC_SEND,		// to envid, value, return value
+	TRACE_IPC_RECV,		// dstva
+	TRACE_HALT,		// (none)
+};
+
+struct TraceEvent {
+	uint64_t te_tsc;		// Time stamp counter
+	uint32_t te_type;		// TRACE_*
+	uint32_t te_envid;		// curenv, or 0
+	uint32_t te_arg[4];
+};
+
+struct TraceBuf {
+	volatile uint32_t tb_head;	// Events ever written
+	uint32_t tb_cpu;		// CPU this ring belongs to
+	uint32_t tb_pad[6];
+	struct TraceEvent tb_ev[];
+};
+
+#define TRACE_NEVENTS \
+	((TRACE_BUFSIZE - sizeof(struct TraceBuf)) / sizeof(struct TraceEvent))
+
+#endif /* !JOS_INC_TRACE_H */
@@ -38,6 +38,7 @@
 #define IRQ_SPURIOUS     7
 #define IRQ_IDE         14
 #define IRQ_ERROR       19
+#define IRQ_WAKE        20	// IPI to a halted CPU: work to do
 
 #ifndef __ASSEMBLER__
 
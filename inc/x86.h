@@ -248,6 +248,38 @@ read_tsc(void)
 	return tsc;
 }
 
+static inline uint64_t
+rdmsr(uint32_t msr)
+{
+	uint64_t val;
+	asm volatile("rdmsr" : "=A" (val) : "c" (msr));
+	return val;
+}
+
+static inline void
+wrmsr(uint32_t msr, uint64_t val)
+{
+	asm volatile("wrmsr" : : "c" (msr), "A" (val));
+}
+
+// Index of the least significant set bit of 'x'.  'x' must be nonzero.
+static inline uint32_t
+bsf(uint32_t x)
+{
+	uint32_t r;
+	asm("bsfl %1,%0" : "=r" (r) : "rm" (x) : "cc");
+	return r;
+}
+
+// Index of the most significant set bit of 'x'.  'x' must be nonzero.
+static inline uint32_t
+bsr(uint32_t x)
+{
+	uint32_t r;
+	asm("bsrl %1,%0" : "=r" (r) : "rm" (x) : "cc");
+	return r;
+}
+
 static inline uint32_t
 xchg(volatile uint32_t *addr, uint32_t newval)
 {
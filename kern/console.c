@@ -5,10 +5,12 @@
 #include <inc/kbdreg.h>
 #include <inc/string.h>
 #include <inc/assert.h>
+#include <inc/error.h>
 
 #include <kern/console.h>
 #include <kern/trap.h>
 #include <kern/picirq.h>
+#include <kern/waitq.h>
 
 #define DEFAULT_FG_COLOR 0x07
 #define DEFAULT_BG_COLOR 0x00
@@ -40,8 +42,16 @@ delay(void)
 #define COM_DLM		1	// Out: Divisor Latch High (DLAB=1)
 #define COM_IER		1	// Out: Interrupt Enable Register
 #define   COM_IER_RDI	0x01	//   Enable receiver data interrupt
+#define   COM_IER_TXI	0x02	//   Enable transmitter empty interrupt
 #define COM_IIR		2	// In:	Interrupt ID Register
 #define COM_FCR		2	// Out: FIFO Control Register
+#define   COM_FCR_ENABLE 0x01	//   Enable the FIFOs
+#define   COM_FCR_RXCLR	0x02	//   Clear the receive FIFO
+#define   COM_FCR_TXCLR	0x04	//   Clear the transmit FIFO
+#define   COM_FCR_TRIG1	0x00	//   Receive interrupt at 1 byte
+#define   COM_FCR_TRIG4	0x40	//   ... 4 bytes
+#define   COM_FCR_TRIG8	0x80	//   ... 8 bytes
+#define   COM_FCR_TRIG14 0xC0	//   ... 14 bytes
 #define COM_LCR		3	// Out: Line Control Register
 #define	  COM_LCR_DLAB	0x80	//   Divisor latch access bit
 #define	  COM_LCR_WLEN8	0x03	//   Wordlength: 8 bits
@@ -51,24 +61,64 @@ delay(void)
 #define	  COM_MCR_OUT2	0x08	// Out2 complement
 #define COM_LSR		5	// In:	Line Status Register
 #define   COM_LSR_DATA	0x01	//   Data available
+#define   COM_LSR_OE	0x02	//   Overrun: received data was lost
 #define   COM_LSR_TXRDY	0x20	//   Transmit buffer avail
 #define   COM_LSR_TSRE	0x40	//   Transmitter off
 
+#define COM_FIFOSIZE	16	// Bytes the transmit FIFO holds
+#define COM_CLOCK	115200	// Baud rate with divisor 1
+
+// Initial speed; serial_config can change it.
+#ifndef SERIAL_BAUD
+#define SERIAL_BAUD	115200
+#endif
+
 static bool serial_exists;
+static int serial_txroom;	// Bytes we can write before checking LSR
+struct SerialStats serial_stats;
+
+static void serial_tx_start(void);
 
 static int
 serial_proc_data(void)
 {
-	if (!(inb(COM1+COM_LSR) & COM_LSR_DATA))
+	uint8_t lsr = inb(COM1+COM_LSR);
+
+	if (lsr & COM_LSR_OE)
+		serial_stats.ss_overruns++;
+	if (!(lsr & COM_LSR_DATA))
 		return -1;
+	serial_stats.ss_rxbytes++;
 	return inb(COM1+COM_RX);
 }
 
+// Is there room in the transmit FIFO?  Once the FIFO drains we can
+// write COM_FIFOSIZE bytes without looking at LSR again.  serial_putc
+// writes even when it gives up waiting, which can leave serial_txroom
+// negative.
+static bool
+serial_txready(void)
+{
+	if (serial_txroom <= 0 && (inb(COM1 + COM_LSR) & COM_LSR_TXRDY))
+		serial_txroom = COM_FIFOSIZE;
+	return serial_txroom > 0;
+}
+
+static void
+serial_tx(int c)
+{
+	outb(COM1 + COM_TX, c);
+	serial_txroom--;
+	serial_stats.ss_txbytes++;
+}
+
 void
 serial_intr(void)
 {
-	if (serial_exists)
+	if (serial_exists) {
 		cons_intr(serial_proc_data);
+		serial_tx_start();
+	}
 }
 
 static void
@@ -76,27 +126,54 @@ serial_putc(int c)
 {
 	int i;
 
-	for (i = 0;
-	     !(inb(COM1 + COM_LSR) & COM_LSR_TXRDY) && i < 12800;
-	     i++)
+	for (i = 0; !serial_txready() && i < 12800; i++)
 		delay();
+	if (i > 0)
+		serial_stats.ss_txwaits++;
+	serial_tx(c);
+}
 
-	outb(COM1 + COM_TX, c);
+// Set the line speed to baud, which must divide 115200, and the
+// receive FIFO interrupt threshold to rxtrig bytes (1, 4, 8 or 14).
+// Either may be 0 to leave it alone.  Returns 0 or -E_INVAL.
+int
+serial_config(int baud, int rxtrig)
+{
+	static const uint8_t trig[15] = {
+		[1] = COM_FCR_TRIG1 | COM_FCR_ENABLE,
+		[4] = COM_FCR_TRIG4 | COM_FCR_ENABLE,
+		[8] = COM_FCR_TRIG8 | COM_FCR_ENABLE,
+		[14] = COM_FCR_TRIG14 | COM_FCR_ENABLE,
+	};
+
+	if (baud < 0 || baud > COM_CLOCK || (baud && COM_CLOCK % baud)
+	    || rxtrig < 0 || rxtrig > 14 || (rxtrig && !trig[rxtrig]))
+		return -E_INVAL;
+
+	if (baud) {
+		// Requires DLAB latch
+		outb(COM1+COM_LCR, COM_LCR_DLAB);
+		outb(COM1+COM_DLL, (uint8_t) (COM_CLOCK / baud));
+		outb(COM1+COM_DLM, (uint8_t) ((COM_CLOCK / baud) >> 8));
+		// 8 data bits, 1 stop bit, parity off; turn off DLAB latch
+		outb(COM1+COM_LCR, COM_LCR_WLEN8 & ~COM_LCR_DLAB);
+		serial_stats.ss_baud = baud;
+	}
+	if (rxtrig) {
+		outb(COM1+COM_FCR, trig[rxtrig]);
+		serial_stats.ss_rxtrig = rxtrig;
+	}
+	return 0;
 }
 
 static void
 serial_init(void)
 {
-	// Turn off the FIFO
-	outb(COM1+COM_FCR, 0);
+	// Turn on and clear the FIFOs
+	outb(COM1+COM_FCR, COM_FCR_ENABLE | COM_FCR_RXCLR | COM_FCR_TXCLR);
 
-	// Set speed; requires DLAB latch
-	outb(COM1+COM_LCR, COM_LCR_DLAB);
-	outb(COM1+COM_DLL, (uint8_t) (115200 / 9600));
-	outb(COM1+COM_DLM, 0);
-
-	// 8 data bits, 1 stop bit, parity off; turn off DLAB latch
-	outb(COM1+COM_LCR, COM_LCR_WLEN8 & ~COM_LCR_DLAB);
+	// Set speed and receive threshold
+	serial_config(SERIAL_BAUD, 14);
 
 	// No modem controls
 	outb(COM1+COM_MCR, 0);
@@ -141,6 +218,16 @@ static unsigned addr_6845;
 static uint16_t *crt_buf;
 static uint16_t crt_pos;
 
+// Output goes to a shadow copy of the screen, kept as a ring of rows so
+// that scrolling only clears a row and moves crt_top.  cga_flush then
+// copies the cells that changed to crt_buf in as few runs as possible,
+// and moves the cursor, once per batch of output.
+static uint16_t crt_shadow[CRT_SIZE];
+static int crt_top;			// Ring row shown at the top
+static int crt_dirty_lo = CRT_SIZE;	// Changed screen cells [lo, hi)
+static int crt_dirty_hi;
+static uint16_t crt_cursor;		// Cursor position the 6845 has
+
 static uint8_t ansi_color_map[256] = {
     [30] = 0,  // Black
     [34] = 1,  // Blue
@@ -186,8 +273,63 @@ cga_init(void)
 
 	crt_buf = (uint16_t*) cp;
 	crt_pos = pos;
+	crt_cursor = pos;
+	memmove(crt_shadow, crt_buf, sizeof(crt_shadow));
+}
+
+// The shadow cell for screen position pos.
+static uint16_t *
+cga_cell(int pos)
+{
+	return &crt_shadow[(pos / CRT_COLS + crt_top) % CRT_ROWS * CRT_COLS
+			   + pos % CRT_COLS];
 }
 
+static void
+cga_touch(int lo, int hi)
+{
+	crt_dirty_lo = MIN(crt_dirty_lo, lo);
+	crt_dirty_hi = MAX(crt_dirty_hi, hi);
+}
+
+// Scroll up a line: the top ring row becomes the (blank) bottom one.
+static void
+cga_scroll(uint16_t blank)
+{
+	int i;
+
+	for (i = 0; i < CRT_COLS; i++)
+		crt_shadow[crt_top * CRT_COLS + i] = blank;
+	crt_top = (crt_top + 1) % CRT_ROWS;
+	crt_pos -= CRT_COLS;
+	cga_touch(0, CRT_SIZE);
+}
+
+// Copy changed cells to the screen and move the cursor.
+static void
+cga_flush(void)
+{
+	int row, lo, hi;
+
+	for (row = crt_dirty_lo / CRT_COLS; row * CRT_COLS < crt_dirty_hi; row++) {
+		lo = MAX(crt_dirty_lo, row * CRT_COLS);
+		hi = MIN(crt_dirty_hi, (row + 1) * CRT_COLS);
+		memmove(crt_buf + lo, cga_cell(lo), (hi - lo) * sizeof(uint16_t));
+	}
+	crt_dirty_lo = CRT_SIZE;
+	crt_dirty_hi = 0;
+
+	/* move that little blinky thing */
+	if (crt_cursor != crt_pos) {
+		crt_cursor = crt_pos;
+		outb(addr_6845, 14);
+		outb(addr_6845 + 1, crt_pos >> 8);
+		outb(addr_6845, 15);
+		outb(addr_6845 + 1, crt_pos);
+	}
+}
+
+// Put c on the shadow screen; cga_flush shows it.
 static void
 cga_putc(int c, uint8_t fg_color, uint8_t bg_color)
 {
@@ -202,7 +344,8 @@ cga_putc(int c, uint8_t fg_color, uint8_t bg_color)
     case '\b':
         if (crt_pos > 0) {
             crt_pos--;
-            crt_buf[crt_pos] = (attribute << 8) | ' ';
+            *cga_cell(crt_pos) = (attribute << 8) | ' ';
+            cga_touch(crt_pos, crt_pos + 1);
         }
         break;
     case '\n':
@@ -219,24 +362,14 @@ cga_putc(int c, uint8_t fg_color, uint8_t bg_color)
         cga_putc(' ', fg_color, bg_color);
         break;
     default:
-        crt_buf[crt_pos++] = (attribute << 8) | (c & 0xFF);  // write the character with the attribute
+        *cga_cell(crt_pos) = (attribute << 8) | (c & 0xFF);  // write the character with the attribute
+        cga_touch(crt_pos, crt_pos + 1);
+        crt_pos++;
         break;
     }
 
-    if (crt_pos >= CRT_SIZE) {
-        int i;
-
-        memmove(crt_buf, crt_buf + CRT_COLS, (CRT_SIZE - CRT_COLS) * sizeof(uint16_t));
-        for (i = CRT_SIZE - CRT_COLS; i < CRT_SIZE; i++)
-            crt_buf[i] = (attribute << 8) | ' ';
-        crt_pos -= CRT_COLS;
-    }
-
-    /* move that little blinky thing */
-    outb(addr_6845, 14);
-    outb(addr_6845 + 1, crt_pos >> 8);
-    outb(addr_6845, 15);
-    outb(addr_6845 + 1, crt_pos);
+    if (crt_pos >= CRT_SIZE)
+        cga_scroll((attribute << 8) | ' ');
 }
 
 /***** Keyboard input code *****/
@@ -410,6 +543,67 @@ kbd_init(void)
 
 
 
+/***** Buffered serial output *****/
+// Output from user environments (sys_cputs) is queued in cons_out and
+// fed to the UART from its transmitter-empty interrupt, a FIFO-full at
+// a time, so sys_cputs doesn't wait for the serial line.  The kernel's
+// own output is written synchronously after draining the queue, so it
+// still comes out in order, and works with interrupts off (in the
+// monitor, or after a panic).
+
+#define CONSOUTSIZE 8192
+
+static struct {
+	uint8_t buf[CONSOUTSIZE];
+	uint32_t rpos;			// free-running
+	uint32_t wpos;
+} cons_out;
+
+// Environments sleeping in sys_cputs until cons_out has room.
+struct WaitQueue cons_writers;
+
+// Fill the transmit FIFO from cons_out if it is empty, and ask for an
+// interrupt when it is empty again if there is more to send.
+static void
+serial_tx_start(void)
+{
+	// With nothing queued, still fall through to turn TXI off: left
+	// on, the THR-empty interrupt stays pending and the edge-triggered
+	// IRQ line never sees the next receive interrupt.
+	if (cons_out.rpos != cons_out.wpos && serial_txready()) {
+		serial_stats.ss_bursts++;
+		while (serial_txroom > 0 && cons_out.rpos != cons_out.wpos)
+			serial_tx(cons_out.buf[cons_out.rpos++ % CONSOUTSIZE]);
+		waitq_wakeup(&cons_writers, NENV);
+	}
+	outb(COM1 + COM_IER, COM_IER_RDI
+	     | (cons_out.rpos != cons_out.wpos ? COM_IER_TXI : 0));
+}
+
+// Queue c for the serial port.  Returns 0 if the queue is full.
+static bool
+serial_queue(int c)
+{
+	if (cons_out.wpos - cons_out.rpos == CONSOUTSIZE)
+		return 0;
+	cons_out.buf[cons_out.wpos++ % CONSOUTSIZE] = c;
+	return 1;
+}
+
+// Write out everything queued, synchronously.
+static void
+serial_flush(void)
+{
+	if (cons_out.rpos == cons_out.wpos)
+		return;
+	while (cons_out.rpos != cons_out.wpos)
+		serial_putc(cons_out.buf[cons_out.rpos++ % CONSOUTSIZE]);
+	outb(COM1 + COM_IER, COM_IER_RDI);
+	waitq_wakeup(&cons_writers, NENV);
+}
+
+
+
 /***** General device-independent console code *****/
 // Here we manage the console input buffer,
 // where we stash characters received from the keyboard or serial port
@@ -423,12 +617,16 @@ static struct {
 	uint32_t wpos;
 } cons;
 
+// Environments sleeping in sys_cread until input arrives.
+struct WaitQueue cons_readers;
+
 // called by device interrupt routines to feed input characters
 // into the circular console input buffer.
 static void
 cons_intr(int (*proc)(void))
 {
 	int c;
+	bool added = 0;
 
 	while ((c = (*proc)()) != -1) {
 		if (c == 0)
@@ -436,7 +634,31 @@ cons_intr(int (*proc)(void))
 		cons.buf[cons.wpos++] = c;
 		if (cons.wpos == CONSBUFSIZE)
 			cons.wpos = 0;
+		added = 1;
+	}
+	if (added)
+		waitq_wakeup(&cons_readers, NENV);
+}
+
+// Copy buffered input into buf: up to n characters, stopping after the
+// end of a line.  Returns the number copied, 0 if there is no input.
+// Unlike cons_getc, doesn't poll the devices; interrupts fill the
+// buffer.
+int
+cons_read(char *buf, size_t n)
+{
+	size_t i;
+	int c;
+
+	for (i = 0; i < n && cons.rpos != cons.wpos; ) {
+		c = cons.buf[cons.rpos++];
+		if (cons.rpos == CONSBUFSIZE)
+			cons.rpos = 0;
+		buf[i++] = c;
+		if (c == '\n' || c == '\r')
+			break;
 	}
+	return i;
 }
 
 // return the next input character from the console, or 0 if none waiting
@@ -492,9 +714,10 @@ For simplicity, we only support 2 syntax:
     }	
 }
 
-// output a character to the console
-static void
-cons_putc(int c)
+// Handle c's part in an ANSI color escape.  Returns 1 if c was part of
+// one (and so shouldn't be printed).
+static bool
+cons_ansi(int c)
 {
 	static int ansi_mode = 0;
 	static char ansi_buf[256];
@@ -506,36 +729,64 @@ cons_putc(int c)
 		ansi_buf_index = 0;
 		ansi_mode = 0;
 		parse_apply_ansi_buf(ansi_buf);
-		return;
+		return 1;
 	}
 	else if (!ansi_mode && c == '\033')
 	{
 		ansi_mode = 1;
-		return;
+		return 1;
 	}
 
-	if(!ansi_mode)
-	{
-
-		serial_putc(c);
-		lpt_putc(c);
-		cga_putc(c, console_fg_color, console_bg_color);
-	}
-	else
+	if(ansi_mode)
 	{
 		ansi_buf[ansi_buf_index++] = c;
 		assert(ansi_buf_index < 256);
 	}
+	return ansi_mode;
+}
+
+// output a character to the console; cga_flush puts it on the screen
+static void
+cons_putc(int c)
+{
+	if (serial_exists)
+		serial_flush();
+	if (cons_ansi(c))
+		return;
+	serial_putc(c);
+	lpt_putc(c);
+	cga_putc(c, console_fg_color, console_bg_color);
 }
 
-// output a character to the console
-// static void
-// cons_putc(int c)
-// {
-// 	serial_putc(c);
-// 	lpt_putc(c);
-// 	cga_putc(c, console_fg_color, console_bg_color);
-// }
+// Output s to the console for a user environment, queueing rather than
+// waiting for the serial port.  Returns the number of characters
+// taken, which is less than len if the queue fills.
+int
+cons_write(const char *s, size_t len)
+{
+	size_t i, run;
+
+	for (i = 0; i < len; ) {
+		if (cons_ansi(s[i])) {
+			i++;
+			continue;
+		}
+		// A run of plain characters, up to the next escape
+		for (run = 1; i + run < len && s[i + run] != '\033'; run++)
+			;
+		for (; run > 0; run--, i++) {
+			if (serial_exists && !serial_queue(s[i]))
+				goto out;
+			lpt_putc(s[i]);
+			cga_putc(s[i], console_fg_color, console_bg_color);
+		}
+	}
+out:
+	cga_flush();
+	if (serial_exists)
+		serial_tx_start();
+	return i;
+}
 
 // initialize the console devices
 void
@@ -556,6 +807,21 @@ void
 cputchar(int c)
 {
 	cons_putc(c);
+	cga_flush();
+}
+
+// Like cputchar, but the screen and cursor are only updated by the
+// next cons_flush, so that cprintf updates them once per call.
+void
+cons_putc_deferred(int c)
+{
+	cons_putc(c);
+}
+
+void
+cons_flush(void)
+{
+	cga_flush();
 }
 
 int
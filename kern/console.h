@@ -7,6 +7,7 @@
 #endif
 
 #include <inc/types.h>
+#include <inc/env.h>
 
 #define MONO_BASE	0x3B4
 #define MONO_BUF	0xB0000
@@ -19,8 +20,29 @@
 
 void cons_init(void);
 int cons_getc(void);
+int cons_read(char *buf, size_t n);
+int cons_write(const char *s, size_t len);
+void cons_putc_deferred(int c);
+void cons_flush(void);
+
+extern struct WaitQueue cons_readers;
+extern struct WaitQueue cons_writers;
 
 void kbd_intr(void); // irq 1
 void serial_intr(void); // irq 4
 
+// Serial port settings and counters
+struct SerialStats {
+	int ss_baud;			// Line speed
+	int ss_rxtrig;			// Receive FIFO interrupt threshold
+	uint64_t ss_txbytes;		// Bytes sent
+	uint64_t ss_rxbytes;		// Bytes received
+	uint64_t ss_bursts;		// Transmit FIFO refills from the queue
+	uint64_t ss_txwaits;		// Synchronous writes that had to wait
+	uint64_t ss_overruns;		// Receive overruns seen
+};
+
+extern struct SerialStats serial_stats;
+int serial_config(int baud, int rxtrig);
+
 #endif /* _CONSOLE_H_ */
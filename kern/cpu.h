@@ -23,13 +23,26 @@ struct CpuInfo {
 	volatile unsigned cpu_status;   // The status of the CPU
 	struct Env *cpu_env;            // The currently-running environment.
 	struct Taskstate cpu_ts;        // Used by x86 to find stack for interrupt
-};
+	uint64_t cpu_halt_tsc;          // TSC when the CPU last halted
+	uint64_t cpu_idle_cycles;       // Cycles spent halted before that
+	uint64_t cpu_trap_tsc;          // TSC at the trap being timed, or 0
+	uint32_t cpu_trapno;            // Its trap number
+	uint32_t cpu_sysno;             // and system call number
+	uint32_t cpu_prof_period;       // Sampling period in effect, or 0
+	uint32_t cpu_prof_ticks;        // Timer samples since the last tick
+	uint32_t cpu_timer_count;       // Periodic timer count while busy
+	volatile bool cpu_kicked;       // Sent a wakeup IPI since halting
+	uint64_t cpu_deadline;          // One-shot timer armed while halted
+	uint64_t cpu_run_tsc;           // TSC when curenv was last charged
+	uint64_t cpu_user_tsc;          // TSC when it last entered user mode
+} __attribute__((aligned(CACHELINE)));
 
 // Initialized in mpconfig.c
 extern struct CpuInfo cpus[NCPU];
 extern int ncpu;                    // Total number of CPUs in the system
 extern struct CpuInfo *bootcpu;     // The boot-strap processor (BSP)
 extern physaddr_t lapicaddr;        // Physical MMIO address of the local APIC
+extern uint32_t lapic_quantum;      // LAPIC timer ticks per scheduler tick
 
 // Per-CPU kernel stacks
 extern unsigned char percpu_kstacks[NCPU][KSTKSIZE];
@@ -42,5 +55,12 @@ void lapic_init(void);
 void lapic_startap(uint8_t apicid, uint32_t addr);
 void lapic_eoi(void);
 void lapic_ipi(int vector);
+void lapic_ipi_cpu(int apicid, int vector);
+void lapic_timer(uint32_t count);
+void lapic_timer_stop(void);
+void lapic_timer_resume(void);
+void lapic_oneshot(uint32_t count);
+uint32_t lapic_timer_current(void);
+int lapic_pcint_nmi(bool on);
 
 #endif
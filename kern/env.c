@@ -14,12 +14,23 @@
 #include <kern/sched.h>
 #include <kern/cpu.h>
 #include <kern/spinlock.h>
+#include <kern/waitq.h>
+#include <kern/trace.h>
+#include <kern/stats.h>
+#include <kern/timer.h>
+#include <kern/kclock.h>
+#include <kern/futex.h>
 
-struct Env *envs = NULL;		// All environments
-static struct Env *env_free_list;	// Free environment list
-					// (linked by Env->env_link)
+struct Env *envs = (struct Env *) KENVS;	// All environments
+uint32_t nenvs;				// Slots of envs[] backed by memory
 
-#define ENVGENSHIFT	12		// >= LOGNENV
+// Slots in use, including zombies: bit i of env_used[i / 32] is set
+// for envs[i].  No word below env_hint has a clear bit.
+static uint32_t env_used[NENV / 32];
+static uint32_t env_hint;
+
+#define ENVGENSHIFT	12		// The uniqueifier's place in an env_id
+#define ENVGENMASK	0x0FFFF000
 
 // Global descriptor table.
 //
@@ -88,6 +99,10 @@ envid2env(envid_t envid, struct Env **env_store, bool checkperm)
 	// to ensure that the envid is not stale
 	// (i.e., does not refer to a _previous_ environment
 	// that used the same slot in the envs[] array).
+	if (ENVX(envid) >= nenvs) {
+		*env_store = 0;
+		return -E_BAD_ENV;
+	}
 	e = &envs[ENVX(envid)];
 	if (e->env_status == ENV_FREE || e->env_id != envid) {
 		*env_store = 0;
@@ -108,28 +123,74 @@ envid2env(envid_t envid, struct Env **env_store, bool checkperm)
 	return 0;
 }
 
-// Mark all environments in 'envs' as free, set their env_ids to 0,
-// and insert them into the env_free_list.
-// Make sure the environments are in the free list in the same order
-// they are in the envs array (i.e., so that the first call to
-// env_alloc() returns envs[0]).
-//
+// Set up the envs array.  It starts out empty, with no memory behind
+// it; env_alloc maps pages in as it needs them.
 void
 env_init(void)
 {
 	// Set up envs array
 	// LAB 3: Your code here.
-	for (int i = NENV - 1; i >= 0; i--) {
-		envs[i].env_id = 0;
-		envs[i].env_status = ENV_FREE;
-		envs[i].env_link = env_free_list;
-		env_free_list = &envs[i];
-	}
+	// The scheduler's fields must fit in an Env's first cache line.
+	static_assert(offsetof(struct Env, env_tf) <= CACHELINE);
+	static_assert(NENV * sizeof(struct Env) <= UVTIME - UENVS);
+	nenvs = 0;
+	env_hint = 0;
 
 	// Per-CPU part of the initialization
 	env_init_percpu();
 }
 
+// Make sure envs[envx] has memory behind it, mapping zeroed pages at
+// the end of the array (at KENVS for the kernel, at UENVS for everyone)
+// until it does.  Slots are handed out lowest first, so the array only
+// ever grows at the end.  Returns 0, or -E_NO_MEM.
+static int
+env_grow(uint32_t envx)
+{
+	struct PageInfo *pp;
+	uint32_t off;
+
+	while (envx >= nenvs) {
+		off = ROUNDUP(nenvs * sizeof(struct Env), PGSIZE);
+		if (!(pp = page_alloc(ALLOC_ZERO)))
+			return -E_NO_MEM;
+		if (page_insert(kern_pgdir, pp, (void *) (KENVS + off),
+				PTE_W) < 0
+		    || page_insert(kern_pgdir, pp, (void *) (UENVS + off),
+				   PTE_U) < 0) {
+			page_remove(kern_pgdir, (void *) (KENVS + off));
+			return -E_NO_MEM;
+		}
+		nenvs = MIN((off + PGSIZE) / sizeof(struct Env), NENV);
+	}
+	return 0;
+}
+
+// The lowest free slot in envs[], or -E_NO_FREE_ENV.
+static int
+env_free_slot(void)
+{
+	uint32_t i;
+
+	for (i = env_hint; i < NENV / 32; i++)
+		if (env_used[i] != ~0U) {
+			env_hint = i;
+			return i * 32 + bsf(~env_used[i]);
+		}
+	env_hint = NENV / 32;
+	return -E_NO_FREE_ENV;
+}
+
+// Give e's slot back.
+static void
+env_release_slot(struct Env *e)
+{
+	uint32_t envx = e - envs;
+
+	env_used[envx / 32] &= ~(1U << (envx % 32));
+	env_hint = MIN(env_hint, envx / 32);
+}
+
 // Load GDT and segment descriptors.
 void
 env_init_percpu(void)
@@ -212,27 +273,31 @@ int
 env_alloc(struct Env **newenv_store, envid_t parent_id)
 {
 	int32_t generation;
-	int r;
+	int r, envx;
 	struct Env *e;
 
-	if (!(e = env_free_list))
-		return -E_NO_FREE_ENV;
+	if ((envx = env_free_slot()) < 0)
+		return envx;
+	if ((r = env_grow(envx)) < 0)
+		return r;
+	e = &envs[envx];
 
 	// Allocate and set up the page directory for this environment.
 	if ((r = env_setup_vm(e)) < 0)
 		return r;
 
 	// Generate an env_id for this environment.
-	generation = (e->env_id + (1 << ENVGENSHIFT)) & ~(NENV - 1);
-	if (generation <= 0)	// Don't create a negative env_id.
+	generation = (e->env_id + (1 << ENVGENSHIFT)) & ENVGENMASK;
+	if (generation == 0)	// Don't create an env_id of 0.
 		generation = 1 << ENVGENSHIFT;
-	e->env_id = generation | (e - envs);
+	e->env_id = generation | ENVX_ID(envx);
 
 	// Set the basic status variables.
 	e->env_parent_id = parent_id;
 	e->env_type = ENV_TYPE_USER;
 	e->env_status = ENV_RUNNABLE;
 	e->env_runs = 0;
+	sched_init_env(e);
 
 	// Clear out all the saved register state,
 	// to prevent the register values
@@ -265,8 +330,12 @@ env_alloc(struct Env **newenv_store, envid_t parent_id)
 	// Also clear the IPC receiving flag.
 	e->env_ipc_recving = 0;
 
+	// Unless it calls sys_env_exit, the environment was killed.
+	e->env_exit_status = ENV_EXIT_KILLED;
+	e->env_nzombies = 0;
+
 	// commit the allocation
-	env_free_list = e->env_link;
+	env_used[envx / 32] |= 1U << (envx % 32);
 	*newenv_store = e;
 
 	// cprintf("[%08x] new env %08x\n", curenv ? curenv->env_id : 0, e->env_id);
@@ -409,6 +478,7 @@ env_create(uint8_t *binary, enum EnvType type)
 	if(type == ENV_TYPE_FS)
 	{
 		e->env_tf.tf_eflags |= FL_IOPL_MASK;
+		e->env_priority = ENV_PRIO_FS;
 	}
 }
 
@@ -421,6 +491,8 @@ env_free(struct Env *e)
 	pte_t *pt;
 	uint32_t pdeno, pteno;
 	physaddr_t pa;
+	struct Env *parent;
+	int i;
 
 	// If freeing the current environment, switch to kern_pgdir
 	// before freeing the page directory, just in case the page
@@ -428,6 +500,10 @@ env_free(struct Env *e)
 	if (e == curenv)
 		lcr3(PADDR(kern_pgdir));
 
+	waitq_remove(e);
+	e->env_futex_pa = 0;
+	timer_cancel(&e->env_timer);
+
 	// Note the environment's demise.
 	// cprintf("[%08x] free env %08x\n", curenv ? curenv->env_id : 0, e->env_id);
 
@@ -459,10 +535,134 @@ env_free(struct Env *e)
 	e->env_pgdir = 0;
 	page_decref(pa2page(pa));
 
-	// return the environment to the free list
+	// Children that exited without being waited for can go now.
+	for (i = 0; i < nenvs && e->env_nzombies > 0; i++)
+		if (envs[i].env_zombie && envs[i].env_parent_id == e->env_id)
+			env_reap(&envs[i]);
+
+	// If the parent is still around, keep the slot (and with it
+	// env_id and env_exit_status) until the parent waits for it.
+	// Otherwise return the environment to the free list.
 	e->env_status = ENV_FREE;
-	e->env_link = env_free_list;
-	env_free_list = e;
+	parent = &envs[ENVX(e->env_parent_id)];
+	if (e->env_parent_id && parent->env_id == e->env_parent_id
+	    && parent->env_status != ENV_FREE) {
+		e->env_zombie = 1;
+		parent->env_nzombies++;
+		waitq_wakeup(&parent->env_childq, NENV);
+	} else
+		env_release_slot(e);
+	waitq_wakeup(&e->env_exitq, NENV);
+}
+
+//
+// Unmap every user page below UTOP in e's address space, except those
+// in [keep, keepend).  Unlike env_free, this leaves the page tables in
+// place, for sys_execv to map the new program into; env_free_tables
+// gives back the ones left empty.  The TLB is flushed once at the end
+// rather than page by page.
+//
+void
+env_unmap_user(struct Env *e, uintptr_t keep, uintptr_t keepend)
+{
+	struct PageInfo *pp;
+	uint32_t pdeno, pteno;
+	uintptr_t va;
+	pte_t *pt;
+
+	for (pdeno = 0; pdeno < PDX(UTOP); pdeno++) {
+		if (!(e->env_pgdir[pdeno] & PTE_P))
+			continue;
+		pt = (pte_t*) KADDR(PTE_ADDR(e->env_pgdir[pdeno]));
+		for (pteno = 0; pteno <= PTX(~0); pteno++) {
+			va = (uintptr_t) PGADDR(pdeno, pteno, 0);
+			if (!(pt[pteno] & PTE_P) || (va >= keep && va < keepend))
+				continue;
+			pp = pa2page(PTE_ADDR(pt[pteno]));
+			futex_wake_page(pp);
+			page_decref(pp);
+			pt[pteno] = 0;
+		}
+	}
+	if (e == curenv)
+		lcr3(PADDR(e->env_pgdir));
+}
+
+//
+// Free the page tables in the user part of e's address space that no
+// longer map anything.
+//
+void
+env_free_tables(struct Env *e)
+{
+	uint32_t pdeno, pteno;
+	physaddr_t pa;
+	pte_t *pt;
+
+	for (pdeno = 0; pdeno < PDX(UTOP); pdeno++) {
+		if (!(e->env_pgdir[pdeno] & PTE_P))
+			continue;
+		pa = PTE_ADDR(e->env_pgdir[pdeno]);
+		pt = (pte_t*) KADDR(pa);
+		for (pteno = 0; pteno <= PTX(~0); pteno++)
+			if (pt[pteno] & PTE_P)
+				break;
+		if (pteno <= PTX(~0))
+			continue;
+		e->env_pgdir[pdeno] = 0;
+		page_decref(pa2page(pa));
+	}
+	if (e == curenv)
+		lcr3(PADDR(e->env_pgdir));
+}
+
+// env_timer expired.  If e is still asleep, wake it: a wait on a queue
+// or for IPC fails with -E_TIMEOUT, a plain sleep returns 0.  A timer
+// left over from a sleep that ended some other way does nothing; see
+// trap(), which cancels it once e is back in the kernel.
+static void
+env_timeout(struct Timer *t)
+{
+	struct Env *e;
+
+	e = (struct Env *) ((char *) t - offsetof(struct Env, env_timer));
+	if (e->env_status != ENV_NOT_RUNNABLE)
+		return;
+	if (e->env_ipc_recving)
+		e->env_ipctime += read_tsc() - e->env_ipc_tsc;
+	if (e->env_waitq || e->env_ipc_recving) {
+		waitq_remove(e);
+		e->env_futex_pa = 0;
+		e->env_ipc_recving = 0;
+		e->env_tf.tf_regs.reg_eax = -E_TIMEOUT;
+	}
+	e->env_status = ENV_RUNNABLE;
+	sched_wake(e, 0);
+}
+
+// Cut curenv's coming sleep short after ns nanoseconds; 0 means never.
+// Call just before putting curenv to sleep.
+void
+env_sleep_timeout(uint64_t ns)
+{
+	if (ns)
+		timer_add(&curenv->env_timer, clock_ns() + ns, env_timeout);
+}
+
+// e is a zombie whose parent has waited for it, or exited: return it to
+// the free list.
+void
+env_reap(struct Env *e)
+{
+	assert(e->env_status == ENV_FREE && e->env_zombie);
+	e->env_zombie = 0;
+	envs[ENVX(e->env_parent_id)].env_nzombies--;
+	// Retire the old env_id so that a later sys_wait on it fails
+	// instead of seeing the stale exit status.  Step the generation
+	// rather than zeroing it, so env_alloc never reissues an old id.
+	e->env_id = ((e->env_id + (1 << ENVGENSHIFT)) & ENVGENMASK)
+		| ENVX_ID(e - envs);
+	env_release_slot(e);
 }
 
 //
@@ -543,16 +743,23 @@ env_run(struct Env *e)
 	//	e->env_tf to sensible values.
 
 	// LAB 3: Your code here.
+	stats_trap_exit();
+	sched_charge();
+	if (curenv != e)
+		trace_event(TRACE_RUN, e->env_id, curenv ? curenv->env_id : 0, 0);
 	if (curenv) {
 		if (curenv->env_status == ENV_RUNNING) {
 			curenv->env_status = ENV_RUNNABLE;
 		}
 	}
+	if (curenv != e && e->env_runs && e->env_cpunum != cpunum())
+		e->env_migrations++;
 	curenv = e;
 	pde_t *pde = pgdir_walk(e->env_pgdir, (void *)UENVS, 0);
 	curenv->env_status = ENV_RUNNING;
 	curenv->env_runs++;
 	lcr3(PADDR(curenv->env_pgdir));
+	thiscpu->cpu_user_tsc = read_tsc();
 	env_pop_tf(&curenv->env_tf);
 }
 
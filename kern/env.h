@@ -7,6 +7,7 @@
 #include <kern/cpu.h>
 
 extern struct Env *envs;		// All environments
+extern uint32_t nenvs;			// Slots of envs[] backed by memory
 #define curenv (thiscpu->cpu_env)		// Current environment
 extern struct Segdesc gdt[];
 
@@ -14,6 +15,10 @@ void	env_init(void);
 void	env_init_percpu(void);
 int	env_alloc(struct Env **e, envid_t parent_id);
 void	env_free(struct Env *e);
+void	env_unmap_user(struct Env *e, uintptr_t keep, uintptr_t keepend);
+void	env_free_tables(struct Env *e);
+void	env_reap(struct Env *e);
+void	env_sleep_timeout(uint64_t ns);
 void	env_create(uint8_t *binary, enum EnvType type);
 void	env_destroy(struct Env *e);	// Does not return if e == curenv
 
@@ -0,0 +1,120 @@
+// Futexes: let an environment sleep until another one changes a word
+// of shared memory and says so.
+//
+// A waiter sleeps on one of futex_queues, chosen by the page its word
+// is in, with env_futex_pa set to the word's physical address.  Keying
+// on the physical address means environments that map the same page at
+// different virtual addresses (a pipe shared across fork, say, or the
+// read-only envs[] at UENVS) still find each other.
+//
+// Removing any mapping of a page wakes everyone waiting on a word in
+// it.  Together with the page reference count check in futex_wait,
+// that lets code which notices "the other side has gone away" by
+// reference counts, like pipes, sleep without missing it happen.
+
+#include <inc/error.h>
+#include <inc/assert.h>
+
+#include <kern/futex.h>
+#include <kern/sched.h>
+#include <kern/waitq.h>
+
+#define FUTEX_NHASH	64
+
+// Waiters on all words in one page share a queue, so futex_wake_page
+// only has to look at one.
+static struct WaitQueue futex_queues[FUTEX_NHASH];
+
+static struct WaitQueue *
+futex_queue(physaddr_t pa)
+{
+	return &futex_queues[PGNUM(pa) % FUTEX_NHASH];
+}
+
+// Look up the word at user address 'va' in curenv.
+static int
+futex_lookup(const uint32_t *va, struct PageInfo **pp, physaddr_t *pa)
+{
+	pte_t *pte;
+
+	if ((uintptr_t) va >= ULIM || (uintptr_t) va % 4)
+		return -E_INVAL;
+	if (!(*pp = page_lookup(curenv->env_pgdir, (void *) va, &pte))
+	    || !(*pte & PTE_U))
+		return -E_FAULT;
+	*pa = page2pa(*pp) + PGOFF(va);
+	return 0;
+}
+
+// Wake up to n environments waiting on a word in [lo, hi), which must
+// lie within one page.
+static int
+futex_wake_range(physaddr_t lo, physaddr_t hi, int n)
+{
+	struct Env *e, *next;
+	int woken;
+
+	woken = 0;
+	for (e = futex_queue(lo)->wq_head; e && woken < n; e = next) {
+		next = e->env_wait_next;
+		if (e->env_futex_pa < lo || e->env_futex_pa >= hi)
+			continue;
+		e->env_futex_pa = 0;
+		waitq_wake_env(e);
+		woken++;
+	}
+	return woken;
+}
+
+// If the word at 'uaddr' still holds 'val', and (when pgref >= 0) the
+// page holding it still has reference count pgref, put curenv to sleep
+// until someone calls futex_wake on the word or unmaps the page
+// somewhere.  Checking and sleeping happen under the kernel lock, so a
+// wakeup can't slip in between.
+//
+// Returns 0 right away if the checks fail; otherwise doesn't return,
+// and the system call returns 0 once woken, or -E_TIMEOUT if timeout
+// is nonzero and that many nanoseconds pass first.  Errors are:
+//	-E_INVAL if uaddr is above ULIM or not word-aligned.
+//	-E_FAULT if uaddr isn't mapped.
+int
+futex_wait(const uint32_t *uaddr, uint32_t val, int pgref, uint64_t timeout)
+{
+	struct PageInfo *pp;
+	physaddr_t pa;
+	int r;
+
+	if ((r = futex_lookup(uaddr, &pp, &pa)) < 0)
+		return r;
+	if (*(uint32_t *) KADDR(pa) != val
+	    || (pgref >= 0 && pp->pp_ref != pgref))
+		return 0;
+
+	curenv->env_futex_pa = pa;
+	env_sleep_timeout(timeout);
+	waitq_sleep(futex_queue(pa));
+	curenv->env_tf.tf_regs.reg_eax = 0;
+	sched_yield();
+}
+
+// Wake up to n environments waiting on the word at 'uaddr'.
+// Returns the number woken, or < 0 on error as for futex_wait.
+int
+futex_wake(const uint32_t *uaddr, int n)
+{
+	struct PageInfo *pp;
+	physaddr_t pa;
+	int r;
+
+	if ((r = futex_lookup(uaddr, &pp, &pa)) < 0)
+		return r;
+	return futex_wake_range(pa, pa + 1, n);
+}
+
+// A mapping of page pp is going away, so its reference count is about
+// to drop.  Wake everyone waiting on a word in the page.
+void
+futex_wake_page(struct PageInfo *pp)
+{
+	futex_wake_range(page2pa(pp), page2pa(pp) + PGSIZE, NENV);
+}
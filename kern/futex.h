@@ -0,0 +1,18 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_FUTEX_H
+#define JOS_KERN_FUTEX_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+#include <kern/env.h>
+#include <kern/pmap.h>
+
+int	futex_wait(const uint32_t *uaddr, uint32_t val, int pgref,
+		   uint64_t timeout);
+int	futex_wake(const uint32_t *uaddr, int n);
+void	futex_wake_page(struct PageInfo *pp);
+
+#endif	// !JOS_KERN_FUTEX_H
@@ -6,6 +6,7 @@
 
 #include <kern/monitor.h>
 #include <kern/console.h>
+#include <kern/trace.h>
 #include <kern/pmap.h>
 #include <kern/kclock.h>
 #include <kern/env.h>
@@ -29,6 +30,7 @@ i386_init(void)
 
 	// Lab 2 memory management initialization functions
 	mem_init();
+	trace_init();
 
 	// Lab 3 user environment initialization functions
 	env_init();
@@ -37,6 +39,7 @@ i386_init(void)
 	// Lab 4 multiprocessor initialization functions
 	mp_init();
 	lapic_init();
+	clock_init();
 
 	// Lab 4 multitasking initialization functions
 	pic_init();
@@ -1,11 +1,27 @@
 /* See COPYRIGHT for copyright information. */
 
-/* Support for reading the NVRAM from the real-time clock. */
+/* Support for reading the NVRAM from the real-time clock, and for
+ * calibrating the TSC and the LAPIC timer against the 8253 PIT. */
 
 #include <inc/x86.h>
+#include <inc/stdio.h>
 
 #include <kern/kclock.h>
+#include <kern/cpu.h>
 
+#define	IO_PIT		0x040		/* 8253 PIT ports */
+#define	PIT_CH2		(IO_PIT + 2)
+#define	PIT_CMD		(IO_PIT + 3)
+#define	PIT_HZ		1193182		/* PIT input clock */
+#define	IO_PORTB	0x061		/* Channel 2 gate and output */
+#define	PORTB_GATE2	0x01
+#define	PORTB_SPKR	0x02
+#define	PORTB_OUT2	0x20
+
+#define	CAL_HZ		20		/* calibrate over 1/CAL_HZ seconds */
+
+// The calibration page, allocated in mem_init and mapped at UVTIME.
+struct VTime *vtime;
 
 unsigned
 mc146818_read(unsigned reg)
@@ -20,3 +36,83 @@ mc146818_write(unsigned reg, unsigned datum)
 	outb(IO_RTC, reg);
 	outb(IO_RTC+1, datum);
 }
+
+// Count TSC and LAPIC timer ticks across one run of PIT channel 2 in
+// mode 0 ("interrupt on terminal count"), whose output we can poll in
+// port B without taking an interrupt.  Returns 0, or -1 if the PIT
+// never finished.
+static int
+pit_calibrate(uint64_t *tsc_hz, uint64_t *lapic_hz)
+{
+	uint32_t latch = PIT_HZ / CAL_HZ, l0, l1;
+	uint64_t t0, t1;
+
+	outb(IO_PORTB, (inb(IO_PORTB) & ~PORTB_SPKR) | PORTB_GATE2);
+	outb(PIT_CMD, 0xB0);		/* channel 2, lo/hi byte, mode 0 */
+	outb(PIT_CH2, latch & 0xFF);
+	outb(PIT_CH2, latch >> 8);
+
+	t0 = read_tsc();
+	l0 = lapic_timer_current();
+	while (!(inb(IO_PORTB) & PORTB_OUT2))
+		if (read_tsc() - t0 > (1ULL << 36))
+			return -1;
+	t1 = read_tsc();
+	l1 = lapic_timer_current();
+
+	*tsc_hz = (t1 - t0) * CAL_HZ;
+	*lapic_hz = (uint64_t) (l0 - l1) * CAL_HZ;
+	return 0;
+}
+
+// Calibrate the TSC and the LAPIC timer, publish the results in
+// *vtime, and set the scheduler tick to 1/SCHED_HZ seconds.  Must run
+// on the boot CPU after lapic_init and before the APs start; they
+// assume the same TSC and bus clocks.
+void
+clock_init(void)
+{
+	uint64_t tsc_hz, lapic_hz, mult;
+	uint32_t shift;
+
+	// Let the LAPIC timer run freely while we count.
+	lapic_timer(0xFFFFFFFF);
+	if (pit_calibrate(&tsc_hz, &lapic_hz) < 0 || !tsc_hz || !lapic_hz) {
+		cprintf("clock: PIT calibration failed; guessing 1GHz\n");
+		tsc_hz = lapic_hz = 1000000000;
+	}
+
+	// Largest shift that keeps the multiplier within 32 bits.
+	for (shift = 32; shift > 0; shift--)
+		if ((mult = (1000000000ULL << shift) / tsc_hz) < (1ULL << 32))
+			break;
+	vtime->vt_tsc_hz = tsc_hz;
+	vtime->vt_lapic_hz = lapic_hz;
+	vtime->vt_mult = mult;
+	vtime->vt_shift = shift;
+	vtime->vt_tsc_base = read_tsc();
+
+	lapic_quantum = lapic_hz / SCHED_HZ;
+	lapic_timer(lapic_quantum);
+	cprintf("clock: TSC %llu Hz, LAPIC timer %llu Hz\n", tsc_hz, lapic_hz);
+}
+
+// Nanoseconds since clock_init.
+uint64_t
+clock_ns(void)
+{
+	return vtime_ns(vtime, read_tsc());
+}
+
+// The number of LAPIC timer ticks in ns nanoseconds, at least 1 and
+// at most what the timer can count.
+uint32_t
+clock_ns2ticks(uint64_t ns)
+{
+	uint64_t ticks;
+
+	// Anything past 2^33 ns (8.6s) overflows the timer anyway.
+	ticks = MIN(ns, 1ULL << 33) * vtime->vt_lapic_hz / 1000000000;
+
+	return MAX(MIN(ticks, 0xFFFFFFFFULL), 1);
+}
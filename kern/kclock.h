@@ -6,6 +6,8 @@
 # error "This is a JOS kernel header; user programs should not #include it"
 #endif
 
+#include <inc/time.h>
+
 #define	IO_RTC		0x070		/* RTC port */
 
 #define	MC_NVRAM_START	0xe	/* start of NVRAM: offset 14 */
@@ -26,4 +28,13 @@
 unsigned mc146818_read(unsigned reg);
 void mc146818_write(unsigned reg, unsigned datum);
 
+// Scheduler ticks per second while a CPU is busy
+#define SCHED_HZ	100
+
+extern struct VTime *vtime;
+
+void clock_init(void);
+uint64_t clock_ns(void);
+uint32_t clock_ns2ticks(uint64_t ns);
+
 #endif	// !JOS_KERN_KCLOCK_H
@@ -29,6 +29,7 @@
 	#define OTHERS     0x000C0000   // Send to all APICs, excluding self.
 	#define BUSY       0x00001000
 	#define FIXED      0x00000000
+	#define NMI        0x00000400   // NMI delivery mode
 #define ICRHI   (0x0310/4)   // Interrupt Command [63:32]
 #define TIMER   (0x0320/4)   // Local Vector Table 0 (TIMER)
 	#define X1         0x0000000B   // divide counts by 1
@@ -45,6 +46,9 @@
 physaddr_t lapicaddr;        // Initialized in mpconfig.c
 volatile uint32_t *lapic;
 
+// Timer ticks per scheduler tick; set by clock_init.
+uint32_t lapic_quantum = 10000000;
+
 static void
 lapicw(int index, int value)
 {
@@ -66,12 +70,10 @@ lapic_init(void)
 	lapicw(SVR, ENABLE | (IRQ_OFFSET + IRQ_SPURIOUS));
 
 	// The timer repeatedly counts down at bus frequency
-	// from lapic[TICR] and then issues an interrupt.  
-	// If we cared more about precise timekeeping,
-	// TICR would be calibrated using an external time source.
+	// from lapic[TICR] and then issues an interrupt.
+	// clock_init calibrates lapic_quantum against the PIT.
 	lapicw(TDCR, X1);
-	lapicw(TIMER, PERIODIC | (IRQ_OFFSET + IRQ_TIMER));
-	lapicw(TICR, 10000000); 
+	lapic_timer(lapic_quantum);
 
 	// Leave LINT0 of the BSP enabled so that it can get
 	// interrupts from the 8259A chip.
@@ -119,6 +121,61 @@ cpunum(void)
 	return 0;
 }
 
+// Make this CPU's timer interrupt every count ticks.
+void
+lapic_timer(uint32_t count)
+{
+	thiscpu->cpu_timer_count = count;
+	lapic_timer_resume();
+}
+
+// Stop this CPU's timer, to be restarted by lapic_timer_resume.
+void
+lapic_timer_stop(void)
+{
+	if (lapic)
+		lapicw(TICR, 0);
+}
+
+// Restart this CPU's periodic timer at the rate last set by
+// lapic_timer.
+void
+lapic_timer_resume(void)
+{
+	if (!lapic)
+		return;
+	lapicw(TIMER, PERIODIC | (IRQ_OFFSET + IRQ_TIMER));
+	lapicw(TICR, thiscpu->cpu_timer_count);
+}
+
+// Interrupt once, after count ticks, instead of periodically.
+void
+lapic_oneshot(uint32_t count)
+{
+	if (!lapic)
+		return;
+	lapicw(TIMER, IRQ_OFFSET + IRQ_TIMER);
+	lapicw(TICR, count);
+}
+
+// Ticks left before this CPU's timer fires.
+uint32_t
+lapic_timer_current(void)
+{
+	return lapic ? lapic[TCCR] : 0;
+}
+
+// Deliver performance counter overflows to this CPU as NMIs if on,
+// otherwise mask them.  Returns -1 if the LAPIC has no such interrupt.
+int
+lapic_pcint_nmi(bool on)
+{
+	if (!lapic || ((lapic[VER]>>16) & 0xFF) < 4)
+		return -1;
+	lapicw(PCINT, on ? NMI : MASKED);
+	return 0;
+}
+
 // Acknowledge interrupt.
 void
 lapic_eoi(void)
@@ -173,6 +230,16 @@ lapic_startap(uint8_t apicid, uint32_t addr)
 	}
 }
 
+// Send vector to the CPU whose LAPIC ID is apicid.
+void
+lapic_ipi_cpu(int apicid, int vector)
+{
+	lapicw(ICRHI, apicid << 24);
+	lapicw(ICRLO, FIXED | vector);
+	while (lapic[ICRLO] & DELIVS)
+		;
+}
+
 void
 lapic_ipi(int vector)
 {
@@ -12,6 +12,8 @@
 #include <kern/kdebug.h>
 #include <kern/pmap.h>
 #include <kern/trap.h>
+#include <kern/cpu.h>
+#include <kern/stats.h>
 
 #define CMDBUF_SIZE	80	// enough for one VGA text line
 
@@ -26,12 +28,14 @@ struct Command {
 static struct Command commands[] = {
 	{ "help", "Display this list of commands", mon_help },
 	{ "kerninfo", "Display information about the kernel", mon_kerninfo },
+	{ "stats", "Display trap and system call latency histograms", mon_stats },
 	{ "showmappings", "Display physical page mappings for a range of virtual addresses", mon_showmappings },
 	{ "setperm", "Set permissions of a mapping", mon_setperm },
 	{ "dump", "Dump memory contents for a range of addresses", mon_dump },
 	{ "backtrace", "Display a backtrace of the current stack", mon_backtrace },
 	{ "si", "Single step the program", mon_si },
-	{ "continue", "Continue execution", mon_continue }
+	{ "continue", "Continue execution", mon_continue },
+	{ "serial", "Show serial port counters; set baud rate or rx trigger", mon_serial }
 };
 
 int mon_si(int argc, char **argv, struct Trapframe *tf)
@@ -95,6 +99,34 @@ mon_dump(int argc, char **argv, struct Trapframe *tf)
 	return 0;
 }
 
+int
+mon_serial(int argc, char **argv, struct Trapframe *tf)
+{
+	int baud = 0, rxtrig = 0;
+
+	if (argc == 3 && strcmp(argv[1], "baud") == 0)
+		baud = strtol(argv[2], NULL, 0);
+	else if (argc == 3 && strcmp(argv[1], "rxtrig") == 0)
+		rxtrig = strtol(argv[2], NULL, 0);
+	else if (argc != 1) {
+		cprintf("Usage: serial [baud <rate> | rxtrig <1|4|8|14>]\n");
+		return 0;
+	}
+	if (serial_config(baud, rxtrig) < 0) {
+		cprintf("Bad setting\n");
+		return 0;
+	}
+
+	cprintf("%d baud, rx trigger %d\n", serial_stats.ss_baud,
+		serial_stats.ss_rxtrig);
+	cprintf("tx %llu bytes in %llu bursts, %llu waits\n",
+		serial_stats.ss_txbytes, serial_stats.ss_bursts,
+		serial_stats.ss_txwaits);
+	cprintf("rx %llu bytes, %llu overruns\n", serial_stats.ss_rxbytes,
+		serial_stats.ss_overruns);
+	return 0;
+}
+
 /***** Implementations of basic kernel monitor commands *****/
 int
 mon_setperm(int argc, char **argv, struct Trapframe *tf)
@@ -194,6 +226,41 @@ mon_kerninfo(int argc, char **argv, struct Trapframe *tf)
 	return 0;
 }
 
+static void
+print_hist(const char *what, int n, const struct Hist *h)
+{
+	int b;
+
+	if (h->h_count == 0)
+		return;
+	cprintf("%-20s %3d: %8u, avg %8llu cycles;", what, n, h->h_count,
+		h->h_cycles / h->h_count);
+	for (b = 0; b < STATS_NBUCKETS; b++)
+		if (h->h_bucket[b])
+			cprintf(" 2^%d:%u", b, h->h_bucket[b]);
+	cprintf("\n");
+}
+
+int
+mon_stats(int argc, char **argv, struct Trapframe *tf)
+{
+	static struct Stats st;
+	int cpu = -1, i;
+
+	if (argc == 2)
+		cpu = strtol(argv[1], NULL, 0);
+	if (argc > 2 || cpu >= ncpu) {
+		cprintf("Usage: stats [cpu]\n");
+		return 0;
+	}
+	stats_get(cpu, &st);
+	for (i = 0; i < STATS_NTRAPS; i++)
+		print_hist(trapname(i), i, &st.st_trap[i]);
+	for (i = 0; i < NSYSCALLS; i++)
+		print_hist("syscall", i, &st.st_syscall[i]);
+	return 0;
+}
+
 int
 mon_backtrace(int argc, char **argv, struct Trapframe *tf)
 {
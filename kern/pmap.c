@@ -10,6 +10,10 @@
 #include <kern/kclock.h>
 #include <kern/env.h>
 #include <kern/cpu.h>
+#include <kern/futex.h>
+#include <kern/trace.h>
+#include <kern/stats.h>
+#include <kern/prof.h>
 
 // These variables are set by i386_detect_memory()
 size_t npages;			// Amount of physical memory (in pages)
@@ -135,6 +139,7 @@ void
 mem_init(void)
 {
 	uint32_t cr0;
+	uintptr_t va;
 	size_t n;
 
 	// Find out how much memory the machine has (npages & npages_basemem).
@@ -169,10 +174,24 @@ mem_init(void)
 	memset(pages, 0, npages * sizeof(struct PageInfo));
 
 	//////////////////////////////////////////////////////////////////////
-	// Make 'envs' point to an array of size 'NENV' of 'struct Env'.
-	// LAB 3: Your code here.
-	envs = boot_alloc(NENV * sizeof(struct Env));
-	memset(envs, 0, NENV * sizeof(struct Env));
+	// Make 'trace_bufs' point to NCPU trace rings (see kern/trace.c).
+	trace_bufs = boot_alloc(NCPU * TRACE_BUFSIZE);
+	memset(trace_bufs, 0, NCPU * TRACE_BUFSIZE);
+
+	//////////////////////////////////////////////////////////////////////
+	// Make 'cpu_stats' point to NCPU sets of latency histograms.
+	cpu_stats = boot_alloc(NCPU * sizeof(struct Stats));
+	memset(cpu_stats, 0, NCPU * sizeof(struct Stats));
+
+	//////////////////////////////////////////////////////////////////////
+	// Make 'prof_bufs' point to NCPU profiling sample rings.
+	prof_bufs = boot_alloc(prof_bufsize());
+	memset(prof_bufs, 0, prof_bufsize());
+
+	//////////////////////////////////////////////////////////////////////
+	// Make 'vtime' point to the clock calibration page.
+	vtime = boot_alloc(PGSIZE);
+	memset(vtime, 0, PGSIZE);
 
 
 	//////////////////////////////////////////////////////////////////////
@@ -202,14 +221,18 @@ mem_init(void)
 	, PADDR(pages), PTE_U | PTE_P);
 
 	//////////////////////////////////////////////////////////////////////
-	// Map the 'envs' array read-only by the user at linear address UENVS
-	// (ie. perm = PTE_U | PTE_P).
-	// Permissions:
-	//    - the new image at UENVS  -- kernel R, user R
-	//    - envs itself -- kernel RW, user NONE
-	// LAB 3: Your code here.
-	boot_map_region(kern_pgdir, UENVS, ROUNDUP(NENV * sizeof(struct Env), PGSIZE),
-		PADDR(envs), PTE_U | PTE_P);
+	// The 'envs' array lives at KENVS (kernel RW, user NONE) and again
+	// at UENVS (kernel R, user R), but has no pages until env_alloc
+	// maps them.  Create the page tables for both ranges now, so every
+	// environment's page directory, which copies kern_pgdir's entries
+	// above UTOP, sees the pages as they are added.
+	for (va = KENVS; va < UPAGES; va += PTSIZE)
+		if (!pgdir_walk(kern_pgdir, (void *) va, 1))
+			panic("mem_init: no memory for the envs page tables");
+
+	//////////////////////////////////////////////////////////////////////
+	// Map the clock calibration page read-only by the user at UVTIME.
+	boot_map_region(kern_pgdir, UVTIME, PGSIZE, PADDR(vtime), PTE_U | PTE_P);
 
 	//////////////////////////////////////////////////////////////////////
 	// Use the physical memory that 'bootstack' refers to as the kernel
@@ -595,11 +618,89 @@ page_remove(pde_t *pgdir, void *va)
 	{
 		return;
 	}
+	futex_wake_page(page);
 	page_decref(page);
 	tlb_invalidate(pgdir, va);
 	*pgdir_walk(pgdir, va, 1) = 0;
 }
 
+//
+// Give pgdir a private, writable copy of the copy-on-write page at va.
+// If nothing else maps the page, it is simply made writable.
+//
+// RETURNS:
+//   0 on success
+//   -E_INVAL, if va isn't a user page marked PTE_COW
+//   -E_NO_MEM, if there's no page to copy into
+//
+int
+page_cow(pde_t *pgdir, void *va)
+{
+	struct PageInfo *pp, *np;
+	pte_t *pte;
+	int perm, r;
+
+	va = ROUNDDOWN(va, PGSIZE);
+	pp = page_lookup(pgdir, va, &pte);
+	if (!pp || (*pte & (PTE_U | PTE_COW)) != (PTE_U | PTE_COW))
+		return -E_INVAL;
+	perm = (*pte & PTE_SYSCALL & ~PTE_COW) | PTE_W;
+	if (pp->pp_ref == 1) {
+		*pte = page2pa(pp) | perm;
+		tlb_invalidate(pgdir, va);
+		return 0;
+	}
+	if (!(np = page_alloc(0)))
+		return -E_NO_MEM;
+	memcpy(page2kva(np), page2kva(pp), PGSIZE);
+	if ((r = page_insert(pgdir, np, va, perm)) < 0)
+		page_free(np);
+	return r;
+}
+
+//
+// Return the number of pages on the free list.
+//
+size_t
+page_nfree(void)
+{
+	struct PageInfo *pp;
+	size_t n = 0;
+
+	for (pp = page_free_list; pp; pp = pp->pp_link)
+		n++;
+	return n;
+}
+
+//
+// Count the user pages mapped below UTOP in pgdir into *npages, and
+// those of them that are mapped more than once (here or elsewhere)
+// into *nshared.  Returns the number of page table pages, counting the
+// page directory itself.
+//
+uint32_t
+pgdir_usage(pde_t *pgdir, uint32_t *npages, uint32_t *nshared)
+{
+	uint32_t pdx, ptx, ntables = 1;
+	pte_t *pt;
+
+	*npages = *nshared = 0;
+	for (pdx = 0; pdx < PDX(UTOP); pdx++) {
+		if (!(pgdir[pdx] & PTE_P))
+			continue;
+		ntables++;
+		pt = KADDR(PTE_ADDR(pgdir[pdx]));
+		for (ptx = 0; ptx < NPTENTRIES; ptx++) {
+			if (!(pt[ptx] & PTE_P))
+				continue;
+			(*npages)++;
+			if (pa2page(PTE_ADDR(pt[ptx]))->pp_ref > 1)
+				(*nshared)++;
+		}
+	}
+	return ntables;
+}
+
 //
 // Invalidate a TLB entry, but only if the page tables being
 // edited are the ones currently in use by the processor.
@@ -684,6 +785,11 @@ user_mem_check(struct Env *env, const void *va, size_t len, int perm)
 	for (const void *i = begin; i < end; i += PGSIZE)
 	{
 		pte_t *pte = pgdir_walk(env->env_pgdir, i, 0);
+		// The kernel is about to write here for env, so a
+		// copy-on-write page needs breaking first.
+		if (pte && (perm & PTE_W) && (*pte & PTE_COW)
+		    && (uintptr_t)i < ULIM)
+			page_cow(env->env_pgdir, (void *)i);
 		if (!pte || (~*pte & (perm | PTE_P)) || (uintptr_t)i >= ULIM)
 		{
 			user_mem_check_addr = (uintptr_t)MAX(MIN(i, va+len), va);
@@ -879,10 +985,12 @@ check_kern_pgdir(void)
 		assert(check_va2pa(pgdir, UPAGES + i) == PADDR(pages) + i);
 	}
 
-	// check envs array (new test for lab 3)
-	n = ROUNDUP(NENV*sizeof(struct Env), PGSIZE);
-	for (i = 0; i < n; i += PGSIZE)
-		assert(check_va2pa(pgdir, UENVS + i) == PADDR(envs) + i);
+	// check envs array (new test for lab 3): both views of it, which
+	// hold no pages yet
+	for (i = 0; i < UVTIME - UENVS; i += PGSIZE) {
+		assert(check_va2pa(pgdir, UENVS + i) == ~0);
+		assert(check_va2pa(pgdir, KENVS + i) == ~0);
+	}
 
 	// check phys mem
 	for (i = 0; i < npages * PGSIZE; i += PGSIZE)
@@ -912,7 +1020,9 @@ check_kern_pgdir(void)
 			assert(pgdir[i] & PTE_P);
 			break;
 		default:
-			if (i >= PDX(KERNBASE)) {
+			if (i >= PDX(KENVS) && i < PDX(UPAGES))
+				assert(pgdir[i] & PTE_P);
+			else if (i >= PDX(KERNBASE)) {
 				assert(pgdir[i] & PTE_P);
 				assert(pgdir[i] & PTE_W);
 			} else
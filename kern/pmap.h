@@ -60,6 +60,9 @@ int	page_insert(pde_t *pgdir, struct PageInfo *pp, void *va, int perm);
 void	page_remove(pde_t *pgdir, void *va);
 struct PageInfo *page_lookup(pde_t *pgdir, void *va, pte_t **pte_store);
 void	page_decref(struct PageInfo *pp);
+int	page_cow(pde_t *pgdir, void *va);
+size_t	page_nfree(void);
+uint32_t pgdir_usage(pde_t *pgdir, uint32_t *npages, uint32_t *nshared);
 
 void	tlb_invalidate(pde_t *pgdir, void *va);
 
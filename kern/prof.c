@@ -0,0 +1,210 @@
+// Sampling profiler.
+//
+// Each CPU records samples -- where it was and what it was running --
+// into its own ring.  If the CPU has architectural performance
+// counters, counter 0 counts unhalted cycles and its overflow raises an
+// NMI every 'period' cycles, which samples the kernel as well as user
+// code.  Otherwise the LAPIC timer is sped up to fire every 'period'
+// ticks; since the kernel runs with interrupts off and idle CPUs stop
+// their timers, those samples only ever land in user mode.  The
+// scheduler still gets one timer tick in lapic_quantum / period.
+//
+// A CPU picks up a change of period at its next timer interrupt, so no
+// IPIs are needed.
+
+#include <inc/x86.h>
+#include <inc/error.h>
+#include <inc/string.h>
+
+#include <kern/prof.h>
+#include <kern/cpu.h>
+#include <kern/env.h>
+
+#define MSR_PMC0		0x0C1
+#define MSR_PERFEVTSEL0		0x186
+#define MSR_PERF_GLOBAL_OVF_CTRL 0x390
+	#define EVTSEL_CYCLES	0x0000003C	// Unhalted core cycles
+	#define EVTSEL_USR	0x00010000	// Count in user mode
+	#define EVTSEL_OS	0x00020000	// Count in kernel mode
+	#define EVTSEL_INT	0x00100000	// Interrupt on overflow
+	#define EVTSEL_EN	0x00400000	// Enable
+
+#define PROF_NSAMPLES	4096		// Per CPU; a power of 2
+
+struct ProfBuf {
+	volatile uint32_t pb_head;	// Written only by the owning CPU
+	volatile uint32_t pb_tail;	// Written only by prof_read
+	uint32_t pb_lost;		// Samples dropped on a full ring
+	struct ProfSample pb_s[PROF_NSAMPLES];
+};
+
+// NCPU rings, allocated in mem_init.
+struct ProfBuf *prof_bufs;
+
+static int prof_mode;			// PROF_PMC or PROF_TIMER once chosen
+static int pmc_version;
+static uint32_t prof_period;		// 0 if not profiling
+
+size_t
+prof_bufsize(void)
+{
+	return NCPU * sizeof(struct ProfBuf);
+}
+
+// Architectural performance monitoring version, or 0 if counter 0
+// can't count cycles or overflow can't be routed to an NMI.
+static int
+pmc_probe(void)
+{
+	uint32_t max, eax, ebx;
+
+	cpuid(0, &max, NULL, NULL, NULL);
+	if (max < 0xA)
+		return 0;
+	cpuid(0xA, &eax, &ebx, NULL, NULL);
+	if ((eax & 0xFF) == 0 || ((eax >> 8) & 0xFF) == 0 || (ebx & 1))
+		return 0;
+	if (lapic_pcint_nmi(0) < 0)
+		return 0;
+	return eax & 0xFF;
+}
+
+// Reload counter 0 so it overflows after another period.
+static void
+pmc_arm(uint32_t period)
+{
+	// Writes to the counter sign-extend bit 31.
+	wrmsr(MSR_PMC0, (uint32_t) -period);
+	if (pmc_version >= 2)
+		wrmsr(MSR_PERF_GLOBAL_OVF_CTRL, 1);
+	// Delivering the NMI masked the LVT entry.
+	lapic_pcint_nmi(1);
+}
+
+// Bring this CPU's sampling source in line with prof_period.
+static void
+prof_apply(void)
+{
+	struct CpuInfo *c = thiscpu;
+
+	if (c->cpu_prof_period == prof_period)
+		return;
+	if (prof_mode == PROF_PMC) {
+		wrmsr(MSR_PERFEVTSEL0, 0);
+		lapic_pcint_nmi(0);
+	}
+	lapic_timer(lapic_quantum);
+	c->cpu_prof_period = prof_period;
+	c->cpu_prof_ticks = 0;
+	if (!prof_period)
+		return;
+	if (prof_mode == PROF_PMC) {
+		pmc_arm(prof_period);
+		wrmsr(MSR_PERFEVTSEL0, EVTSEL_CYCLES | EVTSEL_USR | EVTSEL_OS
+		      | EVTSEL_INT | EVTSEL_EN);
+	} else
+		lapic_timer(prof_period);
+}
+
+static void
+prof_record(struct Trapframe *tf)
+{
+	struct CpuInfo *c = thiscpu;
+	struct ProfBuf *pb = &prof_bufs[c - cpus];
+	struct ProfSample *ps;
+
+	if (pb->pb_head - pb->pb_tail >= PROF_NSAMPLES) {
+		pb->pb_lost++;
+		return;
+	}
+	ps = &pb->pb_s[pb->pb_head % PROF_NSAMPLES];
+	ps->ps_eip = tf->tf_eip;
+	ps->ps_envid = c->cpu_env ? c->cpu_env->env_id : 0;
+	ps->ps_cpu = c - cpus;
+	if ((tf->tf_cs & 3) == 3)
+		ps->ps_mode = PROF_USER;
+	else if (c->cpu_status == CPU_HALTED || !c->cpu_env)
+		ps->ps_mode = PROF_IDLE;
+	else
+		ps->ps_mode = PROF_KERNEL;
+	// The sample must be complete before prof_read can see it.
+	asm volatile("" : : : "memory");
+	pb->pb_head++;
+}
+
+// Called first thing for an NMI, possibly with the kernel lock held by
+// this or another CPU, so it touches nothing but this CPU's state.
+// Returns 1 if the NMI was a profiling sample, 0 if it wasn't ours.
+int
+prof_nmi(struct Trapframe *tf)
+{
+	struct CpuInfo *c = thiscpu;
+
+	if (prof_mode != PROF_PMC)
+		return 0;
+	if (c->cpu_prof_period) {
+		prof_record(tf);
+		pmc_arm(c->cpu_prof_period);
+	}
+	return 1;
+}
+
+// Called on every LAPIC timer interrupt.  Returns 1 if the interrupt
+// only took a sample and the scheduler's tick isn't due yet.
+int
+prof_tick(struct Trapframe *tf)
+{
+	struct CpuInfo *c = thiscpu;
+
+	prof_apply();
+	if (prof_mode != PROF_TIMER || !c->cpu_prof_period)
+		return 0;
+	prof_record(tf);
+	if (++c->cpu_prof_ticks * c->cpu_prof_period < lapic_quantum)
+		return 1;
+	c->cpu_prof_ticks = 0;
+	return 0;
+}
+
+// Start sampling every period cycles or ticks, or stop if period is 0.
+// Starting discards old samples.  Returns the PROF_* sampling mode, or
+// -E_INVAL for a bad period.
+int
+prof_ctl(uint32_t period)
+{
+	int i;
+
+	if (period && (period < PROF_MINPERIOD || period > PROF_MAXPERIOD))
+		return -E_INVAL;
+	if (!prof_mode) {
+		pmc_version = pmc_probe();
+		prof_mode = pmc_version ? PROF_PMC : PROF_TIMER;
+	}
+	if (period)
+		for (i = 0; i < ncpu; i++) {
+			prof_bufs[i].pb_tail = prof_bufs[i].pb_head;
+			prof_bufs[i].pb_lost = 0;
+		}
+	prof_period = period;
+	prof_apply();
+	return period ? prof_mode : PROF_OFF;
+}
+
+// Move up to n samples, from all CPUs, into buf and store in *lost the
+// number of samples dropped since profiling started.  Returns the
+// number of samples moved.
+int
+prof_read(struct ProfSample *buf, int n, uint32_t *lost)
+{
+	struct ProfBuf *pb;
+	int i, got = 0;
+
+	*lost = 0;
+	for (i = 0; i < ncpu; i++) {
+		pb = &prof_bufs[i];
+		for (; got < n && pb->pb_tail != pb->pb_head; pb->pb_tail++)
+			buf[got++] = pb->pb_s[pb->pb_tail % PROF_NSAMPLES];
+		*lost += pb->pb_lost;
+	}
+	return got;
+}
@@ -0,0 +1,21 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_PROF_H
+#define JOS_KERN_PROF_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/prof.h>
+#include <inc/trap.h>
+
+struct ProfBuf;
+extern struct ProfBuf *prof_bufs;
+
+size_t	prof_bufsize(void);
+int	prof_ctl(uint32_t period);
+int	prof_read(struct ProfSample *buf, int n, uint32_t *lost);
+int	prof_nmi(struct Trapframe *tf);
+int	prof_tick(struct Trapframe *tf);
+
+#endif	// !JOS_KERN_PROF_H
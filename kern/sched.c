@@ -4,58 +4,202 @@
 #include <kern/env.h>
 #include <kern/pmap.h>
 #include <kern/monitor.h>
+#include <kern/sched.h>
+#include <kern/trace.h>
+#include <kern/stats.h>
+#include <kern/timer.h>
+#include <kern/kclock.h>
+#include <kern/console.h>
 
 void sched_halt(void);
 
-// Choose a user environment to run and run it.
+// Weight of each priority, -20 .. 19, as in Linux: each step is about
+// 10% more or less CPU than its neighbour when competing.
+static const uint32_t sched_weights[SCHED_NPRIO] = {
+	88761, 71755, 56483, 46273, 36291,
+	29154, 23254, 18705, 14949, 11916,
+	9548, 7620, 6100, 4904, 3906,
+	3121, 2501, 1991, 1586, 1277,
+	1024, 820, 655, 526, 423,
+	335, 272, 215, 172, 137,
+	110, 87, 70, 56, 45,
+	36, 29, 23, 18, 15,
+};
+
+// Virtual runtime never goes backwards past this; new and waking
+// environments are placed relative to it.
+static uint64_t sched_min_vruntime;
+
+// Give e its initial scheduling state.  Called by env_alloc.
 void
-sched_yield(void)
+sched_init_env(struct Env *e)
 {
-	struct Env *idle = NULL;
-
-	// Implement simple round-robin scheduling.
-	//
-	// Search through 'envs' for an ENV_RUNNABLE environment in
-	// circular fashion starting just after the env this CPU was
-	// last running.  Switch to the first such environment found.
-	//
-	// If no envs are runnable, but the environment previously
-	// running on this CPU is still ENV_RUNNING, it's okay to
-	// choose that environment. Make sure curenv is not null before
-	// dereferencing it.
-	//
-	// Never choose an environment that's currently running on
-	// another CPU (env_status == ENV_RUNNING). If there are
-	// no runnable environments, simply drop through to the code
-	// below to halt the cpu.
-
-	// LAB 4: Your code here.
-	int start_envx = (curenv != NULL) ? ENVX(curenv->env_id) : 0;
-	for(int step = 0; step < NENV; step++)
-	{
-		int envx = (start_envx + step) % NENV;
-		if(envs[envx].env_status == ENV_RUNNABLE)
-		{
-			idle = &envs[envx];
-			break;
-		}
+	e->env_priority = 0;
+	e->env_vruntime = sched_min_vruntime;
+	e->env_runtime = 0;
+	e->env_affinity = ~0;
+	e->env_migrations = 0;
+	e->env_utime = 0;
+	e->env_ipctime = 0;
+}
+
+// Charge curenv for the cycles since this CPU last switched, and start
+// counting again.  The charge to its virtual runtime is scaled by its
+// weight, so a high-priority environment's advances more slowly.
+void
+sched_charge(void)
+{
+	uint64_t now, delta;
+
+	now = read_tsc();
+	delta = now - thiscpu->cpu_run_tsc;
+	thiscpu->cpu_run_tsc = now;
+	if (!curenv)
+		return;
+	curenv->env_runtime += delta;
+	curenv->env_vruntime += delta * SCHED_WEIGHT0
+		/ sched_weights[curenv->env_priority - ENV_PRIO_MIN];
+}
+
+// Run the runnable environment that is furthest behind in virtual
+// runtime, as in Linux's CFS.  curenv, if still running, keeps the CPU
+// unless some other environment is behind it, or unless 'giveup' is
+// set, when any other runnable environment goes first.
+//
+// Only environments whose affinity includes this CPU are considered,
+// and those that last ran on another CPU count as a little further
+// ahead than they are, so that environments tend to stay where their
+// cache and TLB contents are.
+static void __attribute__((noreturn))
+sched_pick(bool giveup)
+{
+	struct Env *e, *best = NULL;
+	uint64_t key, bestkey = 0, penalty;
+	uint32_t me = 1 << cpunum();
+
+	sched_charge();
+	penalty = vtime->vt_tsc_hz / SCHED_HZ / SCHED_MIGRATE_DIV;
+
+	// curenv may no longer be allowed here; let a CPU that is have it.
+	if (curenv && curenv->env_status == ENV_RUNNING
+	    && !(curenv->env_affinity & me)) {
+		curenv->env_status = ENV_RUNNABLE;
+		sched_wake(curenv, 0);
 	}
-	if(idle == NULL && curenv && curenv->env_status == ENV_RUNNING)
-	{
-		idle = &envs[start_envx];
+
+	for (e = envs; e < envs + nenvs; e++) {
+		if (e->env_status != ENV_RUNNABLE || !(e->env_affinity & me))
+			continue;
+		key = e->env_vruntime;
+		if (e->env_runs && e->env_cpunum != cpunum())
+			key += penalty;
+		if (!best || key < bestkey) {
+			best = e;
+			bestkey = key;
+		}
 	}
-	
+	if (curenv && curenv->env_status == ENV_RUNNING
+	    && (!best || (!giveup && curenv->env_vruntime <= bestkey)))
+		best = curenv;
+
 	// sched_halt never returns
-	if (idle == NULL)
-	{
+	if (best == NULL)
 		sched_halt();
+
+	if (!giveup && best->env_vruntime > sched_min_vruntime)
+		sched_min_vruntime = best->env_vruntime;
+	env_run(best);
+}
+
+// Choose a user environment to run and run it.
+void
+sched_yield(void)
+{
+	sched_pick(0);
+}
+
+// Like sched_yield, but let any other runnable environment go before
+// curenv.  This is what sys_yield does.
+void
+sched_giveup(void)
+{
+	sched_pick(1);
+}
+
+// Called when e becomes runnable after sleeping or being created.
+// Bring its virtual runtime up to near the others', so a long sleep
+// doesn't let it hog the CPU afterwards, but leave it a little ahead
+// of them -- further ahead if it was woken by an IPC message, so that
+// servers and their clients get to answer promptly.  Idle CPUs take no
+// timer interrupts, so also wake one that e may run on, if there is
+// one, to run it -- the one it last ran on if that is idle.
+void
+sched_wake(struct Env *e, bool ipc)
+{
+	struct CpuInfo *c, *pick = NULL;
+	uint64_t credit, floor;
+
+	credit = vtime->vt_tsc_hz / SCHED_HZ;
+	if (ipc)
+		credit *= SCHED_IPC_BOOST;
+	floor = sched_min_vruntime > credit ? sched_min_vruntime - credit : 0;
+	if (e->env_vruntime < floor)
+		e->env_vruntime = floor;
+
+	// A CPU not running anything picks the environment up itself on
+	// its way out of the kernel.
+	if (!curenv && (e->env_affinity & (1 << cpunum())))
+		return;
+	for (c = cpus; c < cpus + ncpu; c++)
+		if (c != thiscpu && c->cpu_status == CPU_HALTED
+		    && !c->cpu_kicked && (e->env_affinity & (1 << (c - cpus)))
+		    && (!pick || c - cpus == e->env_cpunum))
+			pick = c;
+	if (pick) {
+		pick->cpu_kicked = 1;
+		lapic_ipi_cpu(pick->cpu_id, IRQ_OFFSET + IRQ_WAKE);
 	}
+}
 
-	env_run(idle);
+// Before halting, program a one-shot interrupt for the next timer
+// deadline, unless another halted CPU will already be up for it.
+static void
+sched_arm_deadline(void)
+{
+	struct CpuInfo *c;
+	uint64_t next, now;
+
+	if (!(next = timer_next()))
+		return;
+	for (c = cpus; c < cpus + ncpu; c++)
+		if (c != thiscpu && c->cpu_status == CPU_HALTED
+		    && c->cpu_deadline && c->cpu_deadline <= next)
+			return;
+	now = clock_ns();
+	thiscpu->cpu_deadline = next;
+	lapic_oneshot(clock_ns2ticks(next > now ? next - now : 0));
+}
+
+// Total cycles all CPUs have spent halted in sched_halt, including
+// the current stretch of any CPU halted right now.
+uint64_t
+sched_idle_cycles(void)
+{
+	uint64_t now, total;
+	int i;
+
+	now = read_tsc();
+	total = 0;
+	for (i = 0; i < ncpu; i++) {
+		total += cpus[i].cpu_idle_cycles;
+		if (cpus[i].cpu_status == CPU_HALTED)
+			total += now - cpus[i].cpu_halt_tsc;
+	}
+	return total;
 }
 
-// Halt this CPU when there is nothing to do. Wait until the
-// timer interrupt wakes it up. This function never returns.
+// Halt this CPU when there is nothing to do. Wait until an
+// interrupt wakes it up. This function never returns.
 //
 void
 sched_halt(void)
@@ -64,25 +208,43 @@ sched_halt(void)
 
 	// For debugging and testing purposes, if there are no runnable
 	// environments in the system, then drop into the kernel monitor.
-	for (i = 0; i < NENV; i++) {
+	// An environment with a timeout pending will run again by itself,
+	// and one waiting for the console is woken by its interrupts, so
+	// they count too.  Any other wait (a futex, a pipe, a child) only
+	// another environment can end, so if that's all there is we're
+	// deadlocked.
+	for (i = 0; i < nenvs; i++) {
 		if ((envs[i].env_status == ENV_RUNNABLE ||
 		     envs[i].env_status == ENV_RUNNING ||
-		     envs[i].env_status == ENV_DYING))
+		     envs[i].env_status == ENV_DYING) ||
+		    (envs[i].env_status == ENV_NOT_RUNNABLE &&
+		     (envs[i].env_timer.t_pprev ||
+		      envs[i].env_waitq == &cons_readers ||
+		      envs[i].env_waitq == &cons_writers)))
 			break;
 	}
-	if (i == NENV) {
+	if (i == nenvs) {
 		cprintf("No runnable environments in the system!\n");
 		while (1)
 			monitor(NULL);
 	}
 
 	// Mark that no environment is running on this CPU
+	sched_charge();
 	curenv = NULL;
 	lcr3(PADDR(kern_pgdir));
 
 	// Mark that this CPU is in the HALT state, so that when
 	// timer interupts come in, we know we should re-acquire the
-	// big kernel lock
+	// big kernel lock (and count the time spent halted)
+	stats_trap_exit();
+	thiscpu->cpu_halt_tsc = read_tsc();
+	thiscpu->cpu_kicked = 0;
+	// No ticks while idle; sched_wake sends an IPI when there is
+	// work, and trap() restarts the timer.
+	lapic_timer_stop();
+	sched_arm_deadline();
+	trace_event(TRACE_HALT, 0, 0, 0);
 	xchg(&thiscpu->cpu_status, CPU_HALTED);
 
 	// Release the big kernel lock as if we were "leaving" the kernel
@@ -6,7 +6,27 @@
 # error "This is a JOS kernel header; user programs should not #include it"
 #endif
 
-// This function does not return.
+#include <inc/types.h>
+#include <inc/env.h>
+
+// Virtual runtime is charged in cycles scaled by SCHED_WEIGHT0 over the
+// environment's weight; priority 0 has weight SCHED_WEIGHT0.
+#define SCHED_WEIGHT0		1024
+#define SCHED_NPRIO		(ENV_PRIO_MAX - ENV_PRIO_MIN + 1)
+// Scheduler ticks of credit for an environment woken by IPC, rather
+// than the one tick any other wakeup gets
+#define SCHED_IPC_BOOST		2
+// An environment that last ran on another CPU must be this fraction of
+// a tick further behind to be picked over one that ran here
+#define SCHED_MIGRATE_DIV	4
+
+// These functions do not return.
 void sched_yield(void) __attribute__((noreturn));
+void sched_giveup(void) __attribute__((noreturn));
+
+void sched_init_env(struct Env *e);
+void sched_charge(void);
+void sched_wake(struct Env *e, bool ipc);
+uint64_t sched_idle_cycles(void);
 
 #endif	// !JOS_KERN_SCHED_H
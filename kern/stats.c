@@ -0,0 +1,87 @@
+// Per-CPU trap and system call latency histograms; see inc/stats.h.
+//
+// Each CPU only touches its own histograms, so no lock is needed to
+// update them.
+
+#include <inc/x86.h>
+#include <inc/string.h>
+
+#include <kern/stats.h>
+#include <kern/cpu.h>
+
+// NCPU sets of histograms, allocated by mem_init.
+struct Stats *cpu_stats;
+
+static void
+hist_add(struct Hist *h, uint64_t cycles)
+{
+	uint32_t b;
+
+	if (cycles >> 32)
+		b = 32 + bsr(cycles >> 32);
+	else
+		b = cycles ? bsr(cycles) : 0;
+	h->h_cycles += cycles;
+	h->h_count++;
+	h->h_bucket[MIN(b, STATS_NBUCKETS - 1)]++;
+}
+
+static void
+hist_sum(struct Hist *to, const struct Hist *from)
+{
+	int i;
+
+	to->h_cycles += from->h_cycles;
+	to->h_count += from->h_count;
+	for (i = 0; i < STATS_NBUCKETS; i++)
+		to->h_bucket[i] += from->h_bucket[i];
+}
+
+// Called on entry to trap() to start timing tf's trap.
+void
+stats_trap_enter(struct Trapframe *tf)
+{
+	struct CpuInfo *c = thiscpu;
+
+	c->cpu_trap_tsc = read_tsc();
+	c->cpu_trapno = tf->tf_trapno;
+	c->cpu_sysno = tf->tf_regs.reg_eax;
+}
+
+// Called when the CPU leaves the kernel, by returning to user mode or
+// halting, to account the time since the trap that brought it in.
+void
+stats_trap_exit(void)
+{
+	struct CpuInfo *c = thiscpu;
+	struct Stats *st = &cpu_stats[c - cpus];
+	uint64_t cycles;
+
+	if (!c->cpu_trap_tsc)
+		return;
+	cycles = read_tsc() - c->cpu_trap_tsc;
+	c->cpu_trap_tsc = 0;
+	hist_add(&st->st_trap[MIN(c->cpu_trapno, STATS_NTRAPS - 1)], cycles);
+	if (c->cpu_trapno == T_SYSCALL && c->cpu_sysno < NSYSCALLS)
+		hist_add(&st->st_syscall[c->cpu_sysno], cycles);
+}
+
+// Copy CPU cpu's histograms into *st, or the sum over all CPUs if cpu
+// is negative.
+void
+stats_get(int cpu, struct Stats *st)
+{
+	int i, j;
+
+	if (cpu >= 0) {
+		*st = cpu_stats[cpu];
+		return;
+	}
+	memset(st, 0, sizeof(*st));
+	for (i = 0; i < ncpu; i++) {
+		for (j = 0; j < NSYSCALLS; j++)
+			hist_sum(&st->st_syscall[j], &cpu_stats[i].st_syscall[j]);
+		for (j = 0; j < STATS_NTRAPS; j++)
+			hist_sum(&st->st_trap[j], &cpu_stats[i].st_trap[j]);
+	}
+}
@@ -0,0 +1,18 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_STATS_H
+#define JOS_KERN_STATS_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/stats.h>
+#include <inc/trap.h>
+
+extern struct Stats *cpu_stats;
+
+void	stats_trap_enter(struct Trapframe *tf);
+void	stats_trap_exit(void);
+void	stats_get(int cpu, struct Stats *st);
+
+#endif	// !JOS_KERN_STATS_H
@@ -12,13 +12,34 @@
 #include <kern/syscall.h>
 #include <kern/console.h>
 #include <kern/sched.h>
+#include <kern/futex.h>
+#include <kern/waitq.h>
+#include <kern/trace.h>
+#include <kern/stats.h>
+#include <kern/prof.h>
+#include <kern/kdebug.h>
+#include <kern/kclock.h>
+
+// Sleep on wq.  The system call returns 0 once woken.
+static void
+wait_sleep(struct WaitQueue *wq)
+{
+	waitq_sleep(wq);
+	curenv->env_tf.tf_regs.reg_eax = 0;
+	sched_yield();
+}
 
 // Print a string to the system console.
 // The string is exactly 'len' characters long.
+// Returns the number of characters queued for output, which may be
+// fewer than len.  If the output queue is full, sleeps until it has
+// room and returns 0.
 // Destroys the environment on memory errors.
-static void
+static int
 sys_cputs(const char *s, size_t len)
 {
+	int r;
+
 	// Check that the user has permission to read memory [s, s+len).
 	// Destroy the environment if not.
 
@@ -28,8 +49,10 @@ sys_cputs(const char *s, size_t len)
 		user_mem_assert(curenv, s, len, PTE_U);
 	}
 
-	// Print the string supplied by the user.
-	cprintf("%.*s", len, s);
+	// Queue the string supplied by the user.
+	if ((r = cons_write(s, len)) == 0 && len > 0)
+		wait_sleep(&cons_writers);
+	return r;
 }
 
 // Read a character from the system console without blocking.
@@ -40,6 +63,23 @@ sys_cgetc(void)
 	return cons_getc();
 }
 
+// Read console input into buf: whatever has been typed, up to n
+// characters and at most one line.  If nothing has, sleep until the
+// keyboard or serial interrupt brings some and return 0, so the caller
+// should try again.
+static int
+sys_cread(char *buf, size_t n)
+{
+	int r;
+
+	user_mem_assert(curenv, buf, n, PTE_U | PTE_W);
+	if (n == 0)
+		return 0;
+	if ((r = cons_read(buf, n)) == 0)
+		wait_sleep(&cons_readers);
+	return r;
+}
+
 // Returns the current environment's envid.
 static envid_t
 sys_getenvid(void)
@@ -60,14 +100,38 @@ sys_env_destroy(envid_t envid)
 
 	if ((r = envid2env(envid, &e, 1)) < 0)
 		return r;
+	if (e == curenv)
+		e->env_exit_status = 0;
 	env_destroy(e);
 	return 0;
 }
 
+// Exit the current environment with the given status, which sys_wait
+// reports to anyone waiting for it.  Does not return.
+static void
+sys_env_exit(int status)
+{
+	curenv->env_exit_status = status;
+	env_destroy(curenv);
+}
+
 // Deschedule current environment and pick a different one to run.
 static void
 sys_yield(void)
 {
+	sched_giveup();
+}
+
+// Sleep for ns nanoseconds, off the run queue, then return 0.  A
+// zero-length sleep just yields.
+static int
+sys_sleep_ns(uint64_t ns)
+{
+	if (ns == 0)
+		sched_giveup();
+	env_sleep_timeout(ns);
+	curenv->env_status = ENV_NOT_RUNNABLE;
+	curenv->env_tf.tf_regs.reg_eax = 0;
 	sched_yield();
 }
 
@@ -94,6 +158,8 @@ sys_exofork(void)
 	e->env_status = ENV_NOT_RUNNABLE;
 	e->env_tf = curenv->env_tf;
 	e->env_tf.tf_regs.reg_eax = 0;
+	e->env_priority = curenv->env_priority;
+	e->env_affinity = curenv->env_affinity;
 	return e->env_id;
 }
 
@@ -125,9 +191,67 @@ sys_env_set_status(envid_t envid, int status)
 		return -E_INVAL;
 	}
 	e->env_status = status;
+	if (status == ENV_RUNNABLE)
+		sched_wake(e, 0);
+	return 0;
+}
+
+// Set envid's scheduling priority, from ENV_PRIO_MIN (most CPU) to
+// ENV_PRIO_MAX (least).  Children created later inherit it.
+//
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_BAD_ENV if environment envid doesn't currently exist,
+//		or the caller doesn't have permission to change envid.
+//	-E_INVAL if prio is out of range.
+static int
+sys_env_set_priority(envid_t envid, int prio)
+{
+	struct Env *e;
+	int r;
+
+	if ((r = envid2env(envid, &e, 1)) < 0)
+		return r;
+	if (prio < ENV_PRIO_MIN || prio > ENV_PRIO_MAX)
+		return -E_INVAL;
+	// Settle the time run so far at the old weight.
+	if (e == curenv)
+		sched_charge();
+	e->env_priority = prio;
 	return 0;
 }
 
+// Let envid run only on the CPUs in mask, bit i standing for CPU i.
+// Children created later inherit it.  If envid is the caller and the
+// current CPU is not in mask, it moves before the call returns.  The
+// file server has no parent to do this for it, so anyone may move it.
+//
+// Returns the CPUs in mask that exist, on success; < 0 on error.
+// Errors are:
+//	-E_BAD_ENV if environment envid doesn't currently exist,
+//		or the caller doesn't have permission to change envid.
+//	-E_INVAL if mask contains no CPU that exists.
+static int
+sys_env_set_affinity(envid_t envid, uint32_t mask)
+{
+	struct Env *e;
+	int r;
+
+	if ((r = envid2env(envid, &e, 0)) < 0)
+		return r;
+	if (e->env_type != ENV_TYPE_FS && (r = envid2env(envid, &e, 1)) < 0)
+		return r;
+	if (ncpu < 32)
+		mask &= (1U << ncpu) - 1;
+	if (mask == 0)
+		return -E_INVAL;
+	e->env_affinity = mask;
+	if (e == curenv && !(mask & (1 << cpunum()))) {
+		curenv->env_tf.tf_regs.reg_eax = mask;
+		sched_yield();
+	}
+	return mask;
+}
+
 // Set envid's trap frame to 'tf'.
 // tf is modified to make sure that user environments always run at code
 // protection level 3 (CPL 3), interrupts enabled, and IOPL of 0.
@@ -267,13 +391,15 @@ sys_page_map(envid_t srcenvid, void *srcva,
 	{
 		return err;
 	}
-	err = envid2env(dstenvid, &dst_e, 1);
+	// The file server maps its block cache into whichever clients ask
+	// it to (serve_map in fs/serv.c checks who they may name).
+	err = envid2env(dstenvid, &dst_e, curenv->env_type != ENV_TYPE_FS);
 	if(err)
 	{
 		return err;
 	}
-	if((uint32_t)srcva > UTOP || (uint32_t)srcva % PGSIZE ||
-	(uint32_t)dstva > UTOP || (uint32_t)dstva % PGSIZE ||
+	if((uint32_t)srcva >= UTOP || (uint32_t)srcva % PGSIZE ||
+	(uint32_t)dstva >= UTOP || (uint32_t)dstva % PGSIZE ||
 	(perm & (PTE_U | PTE_P)) != (PTE_U | PTE_P)
 	)
 	{
@@ -407,9 +533,11 @@ sys_ipc_try_send(envid_t envid, uint32_t value, void *srcva, unsigned perm)
 	}
 
 	env->env_ipc_recving = 0;
+	env->env_ipctime += read_tsc() - env->env_ipc_tsc;
 	env->env_ipc_from = curenv->env_id;
 	env->env_ipc_value = value;
 	env->env_status = ENV_RUNNABLE;
+	sched_wake(env, 1);
 	return 0;
 }
 
@@ -420,20 +548,25 @@ sys_ipc_try_send(envid_t envid, uint32_t value, void *srcva, unsigned perm)
 // If 'dstva' is < UTOP, then you are willing to receive a page of data.
 // 'dstva' is the virtual address at which the sent page should be mapped.
 //
+// If 'timeout' is nonzero, give up after that many nanoseconds.
+//
 // This function only returns on error, but the system call will eventually
 // return 0 on success.
 // Return < 0 on error.  Errors are:
 //	-E_INVAL if dstva < UTOP but dstva is not page-aligned.
+//	-E_TIMEOUT if nothing arrived within the timeout.
 static int
-sys_ipc_recv(void *dstva)
+sys_ipc_recv(void *dstva, uint64_t timeout)
 {
 	// LAB 4: Your code here.
 	if(dstva < (void *)UTOP && (uintptr_t)dstva % PGSIZE)
 	{
 		return -E_INVAL;
 	}
+	env_sleep_timeout(timeout);
 	curenv->env_status = ENV_NOT_RUNNABLE;
 	curenv->env_ipc_recving = 1;
+	curenv->env_ipc_tsc = read_tsc();
 	curenv->env_ipc_dstva = dstva;
 	curenv->env_tf.tf_regs.reg_eax = 0;
 	sched_yield();
@@ -441,58 +574,126 @@ sys_ipc_recv(void *dstva)
 }
 
 
-int sys_execv(void *elf_buf, uint32_t elf_size, const char **argv)
+// Limits on what sys_execv takes in.
+#define EXEC_MAXARG	12
+#define EXEC_ARGLEN	127
+#define EXEC_MAXPH	16
+
+static char exec_argv[EXEC_MAXARG][EXEC_ARGLEN + 1];
+
+// Check a program header of the image at [image, image + size) for
+// sys_execv.  The segment must lie inside the image, below UTOP, and
+// clear of both the image and the stack page.
+static bool
+exec_segment_ok(const struct Proghdr *ph, uintptr_t image, uint32_t size)
 {
-	static const int _elf_buf_size = 1048576;
-	static const int _argc_max = 12;
-	static const int _arg_maxlen = 127;
-	static char _elf_buf[1048576];
-	static char _argv_buf[12][128];
+	uintptr_t va = ROUNDDOWN(ph->p_va, PGSIZE);
+	uintptr_t end = ph->p_va + ph->p_memsz;
 
-// Move data to kernel
-	assert(elf_size <= _elf_buf_size);
-	memmove(_elf_buf, elf_buf, elf_size);
-	int argc = 0;
-	int string_size = 0;
-	for(argc = 0; argv[argc] != NULL;argc++)
-	{
-		if(argc >= _argc_max)
-		{
-			panic("error");
-		}
-		int arglen = strlen(argv[argc]);
-		if(arglen > _arg_maxlen)
-		{
-			panic("error");
-		}
-		string_size += arglen + 1;
-		memmove(_argv_buf[argc], argv[argc], arglen + 1);
-	}
-	if(string_size > PGSIZE / 2)
-	{
-		panic("error");
-	}
-// unmapp all pages that are not shared
-	for(void *va = 0; (uintptr_t)va < UTOP; va = (void *)((uintptr_t)va + PGSIZE))
-	{
-		int r = sys_page_unmap(curenv->env_id, va);
-		if(r < 0)
-		{
-			panic("error");
+	if (ph->p_filesz > ph->p_memsz || ph->p_offset > size
+	    || ph->p_filesz > size - ph->p_offset
+	    || PGOFF(ph->p_offset) != PGOFF(ph->p_va)
+	    || end < ph->p_va || end > UTOP)
+		return 0;
+	end = ROUNDUP(end, PGSIZE);
+	if (va < image + ROUNDUP(size, PGSIZE) && end > image)
+		return 0;
+	return end <= USTACKTOP - PGSIZE || va >= USTACKTOP;
+}
+
+// Replace the current environment's program with the ELF executable
+// whose size bytes are mapped at the page-aligned address image (see
+// lib/exec.c, which maps the file there from the file server's block
+// cache), and start it with arguments argv.
+//
+// Nothing is staged in the kernel and nothing is read twice.  The old
+// address space goes in one sweep that keeps its page tables for the
+// new program.  Then each segment's pages are moved out of the image
+// into place: read-only for text, copy-on-write for data.  Only the page
+// where a segment's file data ends is copied, so what follows it reads
+// as zero.  The bss is one zero page mapped copy-on-write throughout.
+//
+// Returns 0, in the new program, on success.  Errors are:
+//	-E_INVAL if the image isn't mapped, page-aligned and readable, or
+//		isn't an ELF executable whose segments fit inside it and
+//		below UTOP and stay clear of it, or argv is too long or
+//		isn't readable.
+// Anything that goes wrong once the old program is gone (running out
+// of memory) destroys the environment.
+static int
+sys_execv(void *image, uint32_t size, const char **argv)
+{
+	struct Elf elf;
+	struct Proghdr phs[EXEC_MAXPH], *ph;
+	struct PageInfo *pp, *zero = NULL;
+	pde_t *pgdir = curenv->env_pgdir;
+	uintptr_t va, i;
+	size_t memsz, filesz, off;
+	const char *p;
+	int argc, string_size, len, n, perm, r;
+
+	// Check everything before destroying the old program.
+	if ((uintptr_t) image % PGSIZE || (uintptr_t) image >= UTOP
+	    || size < sizeof(elf) || size > UTOP - (uintptr_t) image
+	    || user_mem_check(curenv, image, size, PTE_U) < 0)
+		return -E_INVAL;
+	memmove(&elf, image, sizeof(elf));
+	if (elf.e_magic != ELF_MAGIC || elf.e_phnum > EXEC_MAXPH
+	    || elf.e_phoff > size
+	    || elf.e_phnum * sizeof(*ph) > size - elf.e_phoff)
+		return -E_INVAL;
+	memmove(phs, image + elf.e_phoff, elf.e_phnum * sizeof(*ph));
+	for (ph = phs; ph < phs + elf.e_phnum; ph++)
+		if (ph->p_type == ELF_PROG_LOAD
+		    && !exec_segment_ok(ph, (uintptr_t) image, size))
+			return -E_INVAL;
+
+	string_size = 0;
+	for (argc = 0; ; argc++) {
+		if (user_mem_check(curenv, argv + argc, sizeof(*argv), PTE_U) < 0)
+			return -E_INVAL;
+		if (!argv[argc])
+			break;
+		if (argc >= EXEC_MAXARG)
+			return -E_INVAL;
+		// Check a page at a time, so strnlen never runs off the
+		// end of what the caller has mapped.
+		for (len = 0; len <= EXEC_ARGLEN; len += n) {
+			p = argv[argc] + len;
+			n = MIN(EXEC_ARGLEN + 1 - len,
+				PGSIZE - PGOFF(p));
+			if (user_mem_check(curenv, p, n, PTE_U) < 0)
+				return -E_INVAL;
+			if ((r = strnlen(p, n)) < n) {
+				len += r;
+				break;
+			}
 		}
+		if (len > EXEC_ARGLEN)
+			return -E_INVAL;
+		memmove(exec_argv[argc], argv[argc], len);
+		exec_argv[argc][len] = 0;
+		string_size += len + 1;
 	}
 
+	// Out with the old, except the image.
+	env_unmap_user(curenv, (uintptr_t) image,
+		       (uintptr_t) image + ROUNDUP(size, PGSIZE));
 
-//initialize stack
-	int r = sys_page_alloc(0, (void *)(USTACKTOP - PGSIZE), PTE_P | PTE_U | PTE_W);
+	// Stack and arguments
+	if (!(pp = page_alloc(ALLOC_ZERO)))
+		goto nomem;
+	if (page_insert(pgdir, pp, (void *) (USTACKTOP - PGSIZE),
+			PTE_P | PTE_U | PTE_W) < 0) {
+		page_free(pp);
+		goto nomem;
+	}
 	char *string_store = (char *)USTACKTOP - string_size;
 	uintptr_t *argv_store = (uintptr_t *)(ROUNDDOWN(string_store, 4) - 4 * (argc + 1));
-
-	for(int i = 0;i < argc; i++)
-	{
-		int len = strlen(_argv_buf[i]);
+	for (i = 0; i < argc; i++) {
+		len = strlen(exec_argv[i]);
 		argv_store[i] = (uintptr_t)string_store;
-		memmove(string_store, _argv_buf[i], len + 1);
+		memmove(string_store, exec_argv[i], len + 1);
 		string_store += len + 1;
 	}
 	argv_store[argc] = 0;
@@ -500,63 +701,278 @@ int sys_execv(void *elf_buf, uint32_t elf_size, const char **argv)
 	argv_store[-2] = argc;
 	curenv->env_tf.tf_esp = (uintptr_t)&argv_store[-2];
 
-	
-// load elf file
-	struct Elf* elf = (struct Elf*)_elf_buf;
-	if(elf->e_magic != ELF_MAGIC)
-	{
-		panic("error");
-	}
-	struct Proghdr* ph = (struct Proghdr*)(_elf_buf + elf->e_phoff);
-	for (int i = 0; i < elf->e_phnum; i++, ph++) {
+	// Segments
+	for (ph = phs; ph < phs + elf.e_phnum; ph++) {
 		if (ph->p_type != ELF_PROG_LOAD)
 			continue;
-		int perm = PTE_P | PTE_U;
+		va = ROUNDDOWN(ph->p_va, PGSIZE);
+		off = ph->p_offset - PGOFF(ph->p_va);
+		filesz = ph->p_filesz + PGOFF(ph->p_va);
+		memsz = ph->p_memsz + PGOFF(ph->p_va);
+		perm = PTE_P | PTE_U;
 		if (ph->p_flags & ELF_PROG_FLAG_WRITE)
-		{
-			perm |= PTE_W;
-		}
-		size_t memsz = ph->p_memsz;
-		uintptr_t va = ph->p_va;
-		size_t filesz = ph->p_filesz;
-		off_t fileoffset = ph->p_offset;
-		if((r = PGOFF((uint32_t)va)))
-		{
-			va -= r;
-			memsz += r;
-			filesz += r;
-			fileoffset -= r;
-		}
-		for(int j = 0; j < memsz; j += PGSIZE)
-		{
-			if ((r = sys_page_alloc(curenv->env_id, (void*) (va + j), perm | PTE_W)) < 0)
-			{
-				panic("error");
-			}
-			if(j >= filesz)
-			{
-				if(!(perm & PTE_W))
-				{
-					sys_page_map(curenv->env_id, (void*) (va + j),
-					curenv->env_id, (void*) (va + j), perm);
-				}
-				continue; // sys_page_alloc return a zero page
+			perm |= PTE_COW;
+
+		for (i = 0; i < memsz; i += PGSIZE) {
+			if (i + PGSIZE <= filesz) {
+				pp = page_lookup(pgdir, image + off + i, NULL);
+			} else if (i < filesz) {
+				if (!(pp = page_alloc(ALLOC_ZERO)))
+					goto nomem;
+				memmove(page2kva(pp), image + off + i, filesz - i);
+			} else {
+				if (!zero && !(zero = page_alloc(ALLOC_ZERO)))
+					goto nomem;
+				pp = zero;
 			}
-			memmove((void*) (va + j), (void *)(_elf_buf + fileoffset + j),
-			MIN(PGSIZE, filesz - j));
-			if(!(perm & PTE_W))
-			{
-				sys_page_map(curenv->env_id, (void*) (va + j),
-				curenv->env_id, (void*) (va + j), perm);
+			if ((r = page_insert(pgdir, pp, (void *) (va + i), perm)) < 0) {
+				if (pp->pp_ref == 0)
+					page_free(pp);
+				goto nomem;
 			}
 		}
 	}
 
-	curenv->env_tf.tf_eip = elf->e_entry;
+	// Out with the image, and with page tables nothing uses now.
+	for (i = 0; i < size; i += PGSIZE)
+		page_remove(pgdir, image + i);
+	env_free_tables(curenv);
+
+	curenv->env_tf.tf_eip = elf.e_entry;
+	return 0;
+
+nomem:
+	if (zero && zero->pp_ref == 0)
+		page_free(zero);
+	env_destroy(curenv);
+	return -E_NO_MEM;
+}
+
+// Sleep until another environment calls sys_futex_wake on 'addr', as
+// long as the word at 'addr' still equals 'val' when we get here.
+// 'addr' may be in a page shared with other environments.  Removing
+// any mapping of that page also wakes the sleeper, and if 'pgref' is
+// not negative we don't sleep at all unless the page's reference count
+// (as pageref() reports it) is still 'pgref'.
+//
+// If 'timeout' is nonzero, give up after that many nanoseconds.
+//
+// Returns 0 when woken, or right away if the checks fail.  Errors are:
+//	-E_INVAL if addr is above ULIM or not 4-byte aligned.
+//	-E_FAULT if addr is not mapped.
+//	-E_TIMEOUT if not woken within the timeout.
+static int
+sys_futex_wait(const uint32_t *addr, uint32_t val, int pgref,
+	       uint64_t timeout)
+{
+	return futex_wait(addr, val, pgref, timeout);
+}
+
+// Wake up to n environments sleeping in sys_futex_wait on 'addr'.
+// Returns the number woken, or < 0 on error as for sys_futex_wait.
+static int
+sys_futex_wake(const uint32_t *addr, int n)
+{
+	return futex_wake(addr, n);
+}
+
+// Wait for environment 'envid' to exit.  If it already has, store its
+// exit status in *status (unless status is null) and return envid; if
+// we are its parent, that also frees its slot.  If it hasn't, sleep
+// until it does and return 0, so the caller should try again.
+//
+// Errors are:
+//	-E_BAD_ENV if envid doesn't exist, is curenv, or exited and was
+//		already waited for by its parent.
+static int
+sys_wait(envid_t envid, int *status)
+{
+	struct Env *e;
+
+	if (status)
+		user_mem_assert(curenv, status, sizeof(*status), PTE_U | PTE_W);
+	if (envid <= 0 || ENVX(envid) >= nenvs)
+		return -E_BAD_ENV;
+	e = &envs[ENVX(envid)];
+	if (e->env_id != envid || e == curenv)
+		return -E_BAD_ENV;
+	if (e->env_status != ENV_FREE)
+		wait_sleep(&e->env_exitq);
+
+	if (status)
+		*status = e->env_exit_status;
+	if (e->env_zombie && e->env_parent_id == curenv->env_id)
+		env_reap(e);
+	return envid;
+}
+
+// Like sys_wait, but for whichever child of curenv exits first.
+// Returns the child's envid, or 0 after sleeping.
+//
+// Errors are:
+//	-E_BAD_ENV if curenv has no children left to wait for.
+static int
+sys_wait_any(int *status)
+{
+	struct Env *e;
+	bool live;
+	int i;
 
+	if (status)
+		user_mem_assert(curenv, status, sizeof(*status), PTE_U | PTE_W);
+	live = 0;
+	for (i = 0; i < nenvs; i++) {
+		e = &envs[i];
+		if (e->env_parent_id != curenv->env_id)
+			continue;
+		if (e->env_zombie) {
+			if (status)
+				*status = e->env_exit_status;
+			env_reap(e);
+			return e->env_id;
+		}
+		if (e->env_status != ENV_FREE)
+			live = 1;
+	}
+	if (!live)
+		return -E_BAD_ENV;
+	wait_sleep(&curenv->env_childq);
 	return 0;
 }
 
+// Map every CPU's trace ring (see inc/trace.h) read-only into curenv,
+// one after the other starting at va.  Returns the number of rings
+// mapped, which is the number of CPUs, or < 0 on error:
+//	-E_INVAL if va is not page-aligned or the rings don't fit below
+//		UTOP.
+//	-E_NO_MEM if there's no memory for page tables.
+static int
+sys_trace_map(void *va)
+{
+	int r;
+
+	if ((r = trace_map(curenv->env_pgdir, va)) < 0)
+		return r;
+	return ncpu;
+}
+
+// Copy CPU cpu's latency histograms (see inc/stats.h) to *st, or their
+// sum over all CPUs if cpu is negative.  Returns the number of CPUs, or
+// -E_INVAL if there is no such CPU.
+static int
+sys_stats(int cpu, struct Stats *st)
+{
+	user_mem_assert(curenv, st, sizeof(*st), PTE_U | PTE_W);
+	if (cpu >= ncpu)
+		return -E_INVAL;
+	stats_get(cpu, st);
+	return ncpu;
+}
+
+// Start sampling on all CPUs every period cycles (or timer ticks, see
+// inc/prof.h), or stop if period is 0.  Returns the PROF_* sampling
+// mode, or -E_INVAL for a bad period.
+static int
+sys_prof_ctl(uint32_t period)
+{
+	return prof_ctl(period);
+}
+
+// Move up to n profiling samples into buf, and the number of samples
+// dropped because a ring was full into *lost.  Returns the number of
+// samples moved.
+static int
+sys_prof_read(struct ProfSample *buf, int n, uint32_t *lost)
+{
+	if (n < 0)
+		return -E_INVAL;
+	user_mem_assert(curenv, buf, n * sizeof(*buf), PTE_U | PTE_W);
+	user_mem_assert(curenv, lost, sizeof(*lost), PTE_U | PTE_W);
+	return prof_read(buf, n, lost);
+}
+
+// Copy the name of the kernel function containing eip into name, which
+// holds len bytes.  Returns 0, or -E_INVAL if eip isn't in the kernel.
+static int
+sys_ksym(uintptr_t eip, char *name, size_t len)
+{
+	struct Eipdebuginfo info;
+
+	user_mem_assert(curenv, name, len, PTE_U | PTE_W);
+	if (eip < KERNBASE || len == 0)
+		return -E_INVAL;
+	debuginfo_eip(eip, &info);
+	len = MIN(len - 1, info.eip_fn_namelen);
+	memmove(name, info.eip_fn_name, len);
+	name[len] = '\0';
+	return 0;
+}
+
+// Store in *ns the nanoseconds since boot.  User code can compute the
+// same thing without a trap from the page at UVTIME (see inc/time.h).
+static int
+sys_time_ns(uint64_t *ns)
+{
+	user_mem_assert(curenv, ns, sizeof(*ns), PTE_U | PTE_W);
+	*ns = clock_ns();
+	return 0;
+}
+
+// Store in *cycles the total TSC cycles that all CPUs have spent
+// halted with nothing to run, and return the number of CPUs.
+// Comparing two readings against read_tsc() gives the idle fraction.
+static int
+sys_idle_cycles(uint64_t *cycles)
+{
+	user_mem_assert(curenv, cycles, sizeof(*cycles), PTE_U | PTE_W);
+	*cycles = sched_idle_cycles();
+	return ncpu;
+}
+
+// Fill *st with envid's CPU time, scheduling state and memory use.  Any
+// environment may look at any other.
+//
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_BAD_ENV if environment envid doesn't currently exist.
+static int
+sys_env_stat(envid_t envid, struct EnvStat *st)
+{
+	struct Env *e;
+	uint64_t ipc;
+	int r;
+
+	user_mem_assert(curenv, st, sizeof(*st), PTE_U | PTE_W);
+	if ((r = envid2env(envid, &e, 0)) < 0)
+		return r;
+	if (e == curenv)
+		sched_charge();
+	ipc = e->env_ipctime;
+	if (e->env_ipc_recving)
+		ipc += read_tsc() - e->env_ipc_tsc;
+
+	st->es_id = e->env_id;
+	st->es_parent_id = e->env_parent_id;
+	st->es_status = e->env_status;
+	st->es_priority = e->env_priority;
+	st->es_cpunum = e->env_cpunum;
+	st->es_runs = e->env_runs;
+	st->es_migrations = e->env_migrations;
+	st->es_user_ns = vtime_cycles2ns(vtime, e->env_utime);
+	st->es_kernel_ns = vtime_cycles2ns(vtime,
+					   e->env_runtime - e->env_utime);
+	st->es_ipc_ns = vtime_cycles2ns(vtime, ipc);
+	st->es_ptables = pgdir_usage(e->env_pgdir, &st->es_pages,
+				     &st->es_shared);
+	return 0;
+}
+
+// Returns the number of free physical pages.
+static int
+sys_pages_free(void)
+{
+	return page_nfree();
+}
+
 // Dispatches to the correct kernel function, passing the arguments.
 int32_t
 syscall(uint32_t syscallno, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5)
@@ -564,11 +980,11 @@ syscall(uint32_t syscallno, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4,
 	// Call the function corresponding to the 'syscallno' parameter.
 	// Return any appropriate return value.
 	// LAB 3: Your code here.
+	int r;
 
 	switch (syscallno) {
 	case SYS_cputs:
-		sys_cputs((const char *)a1, (size_t)a2);
-		return 0;
+		return sys_cputs((const char *)a1, (size_t)a2);
 	case SYS_cgetc:
 		return sys_cgetc();
 	case SYS_getenvid:
@@ -578,10 +994,20 @@ syscall(uint32_t syscallno, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4,
 	case SYS_yield:
 		sys_yield();
 		return 0;
+	case SYS_sleep_ns:
+		return sys_sleep_ns(a1 | (uint64_t)a2 << 32);
 	case SYS_exofork:
 		return sys_exofork();
 	case SYS_env_set_status:
 		return sys_env_set_status((envid_t)a1, (int)a2);
+	case SYS_env_set_priority:
+		return sys_env_set_priority((envid_t)a1, (int)a2);
+	case SYS_env_set_affinity:
+		return sys_env_set_affinity((envid_t)a1, a2);
+	case SYS_env_stat:
+		return sys_env_stat((envid_t)a1, (struct EnvStat *)a2);
+	case SYS_pages_free:
+		return sys_pages_free();
 	case SYS_page_alloc:
 		return sys_page_alloc((envid_t)a1, (void *)a2, (int)a3);
 	case SYS_page_map:
@@ -591,13 +1017,45 @@ syscall(uint32_t syscallno, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4,
 	case SYS_env_set_pgfault_upcall:
 		return sys_env_set_pgfault_upcall((envid_t)a1, (void *)a2);
 	case SYS_ipc_try_send:
-		return sys_ipc_try_send((envid_t)a1, (uint32_t)a2, (void *)a3, (unsigned int)a4);
+		r = sys_ipc_try_send((envid_t)a1, (uint32_t)a2, (void *)a3, (unsigned int)a4);
+		trace_event(TRACE_IPC_SEND, a1, a2, r);
+		return r;
 	case SYS_ipc_recv:
-		return sys_ipc_recv((void *)a1);
+		trace_event(TRACE_IPC_RECV, a1, 0, 0);
+		return sys_ipc_recv((void *)a1, a2 | (uint64_t)a3 << 32);
 	case SYS_env_set_trapframe:
 		return sys_env_set_trapframe((envid_t)a1, (struct Trapframe *)a2);
 	case SYS_execv:
 		return sys_execv((void *)a1, (uint32_t)a2, (const char **)a3);
+	case SYS_futex_wait:
+		return sys_futex_wait((const uint32_t *)a1, a2, (int)a3,
+				      a4 | (uint64_t)a5 << 32);
+	case SYS_futex_wake:
+		return sys_futex_wake((const uint32_t *)a1, (int)a2);
+	case SYS_env_exit:
+		sys_env_exit((int)a1);
+		return 0;
+	case SYS_wait:
+		return sys_wait((envid_t)a1, (int *)a2);
+	case SYS_wait_any:
+		return sys_wait_any((int *)a1);
+	case SYS_cread:
+		return sys_cread((char *)a1, (size_t)a2);
+	case SYS_trace_map:
+		return sys_trace_map((void *)a1);
+	case SYS_stats:
+		return sys_stats((int)a1, (struct Stats *)a2);
+	case SYS_prof_ctl:
+		return sys_prof_ctl(a1);
+	case SYS_prof_read:
+		return sys_prof_read((struct ProfSample *)a1, (int)a2,
+				     (uint32_t *)a3);
+	case SYS_ksym:
+		return sys_ksym(a1, (char *)a2, a3);
+	case SYS_time_ns:
+		return sys_time_ns((uint64_t *)a1);
+	case SYS_idle_cycles:
+		return sys_idle_cycles((uint64_t *)a1);
 	default:
 		return -E_INVAL;
 	}
@@ -0,0 +1,148 @@
+// Hierarchical timer wheel.
+//
+// Time is counted in jiffies of 2^TIMER_SHIFT ns (about 1ms).  Level 0
+// has one slot per jiffy for the next WHEEL_SIZE jiffies; each level
+// above has slots WHEEL_SIZE times as wide.  A timer goes in the lowest
+// level whose span covers its deadline, and is moved down a level
+// ("cascaded") when the wheel reaches its slot, so adding and
+// cancelling are O(1) and each timer is touched at most once per level.
+//
+// timer_run advances the wheel from the LAPIC timer interrupt.  Busy
+// CPUs tick at SCHED_HZ; an idle CPU programs a one-shot interrupt for
+// timer_next() before halting, so sleeps end on time even when nothing
+// else is running.
+//
+// Everything here runs under the kernel lock.
+
+#include <inc/assert.h>
+
+#include <kern/timer.h>
+#include <kern/kclock.h>
+
+#define TIMER_SHIFT	20
+#define WHEEL_BITS	6
+#define WHEEL_SIZE	(1 << WHEEL_BITS)
+#define WHEEL_LEVELS	4
+#define WHEEL_SPAN(l)	(1ULL << (WHEEL_BITS * ((l) + 1)))
+
+static struct Timer *wheel[WHEEL_LEVELS][WHEEL_SIZE];
+static uint64_t wheel_now;		// Next jiffy to run
+static int ntimers;
+
+// The jiffy t fires in: the first one that starts at or after its
+// deadline, so it never fires early.
+static uint64_t
+timer_jiffy(struct Timer *t)
+{
+	return (t->t_expire + (1 << TIMER_SHIFT) - 1) >> TIMER_SHIFT;
+}
+
+static void
+wheel_insert(struct Timer *t)
+{
+	uint64_t j = timer_jiffy(t);
+	struct Timer **slot;
+	int l;
+
+	if (j < wheel_now)
+		j = wheel_now;
+	for (l = 0; l < WHEEL_LEVELS - 1; l++)
+		if (j - wheel_now < WHEEL_SPAN(l))
+			break;
+	// Past the top level's span: park in its furthest slot and let
+	// cascading look again later.
+	if (j - wheel_now >= WHEEL_SPAN(l))
+		j = wheel_now + WHEEL_SPAN(l) - 1;
+	slot = &wheel[l][(j >> (WHEEL_BITS * l)) % WHEEL_SIZE];
+
+	t->t_next = *slot;
+	if (t->t_next)
+		t->t_next->t_pprev = &t->t_next;
+	t->t_pprev = slot;
+	*slot = t;
+}
+
+// Call fn(t) at clock_ns() time expire (or soon after), unless
+// cancelled first.  Re-adding a pending timer moves it.
+void
+timer_add(struct Timer *t, uint64_t expire, void (*fn)(struct Timer *))
+{
+	timer_cancel(t);
+	t->t_expire = expire;
+	t->t_fn = fn;
+	if (ntimers++ == 0)
+		wheel_now = clock_ns() >> TIMER_SHIFT;
+	wheel_insert(t);
+}
+
+// Make t idle if it is pending.
+void
+timer_cancel(struct Timer *t)
+{
+	if (!t->t_pprev)
+		return;
+	*t->t_pprev = t->t_next;
+	if (t->t_next)
+		t->t_next->t_pprev = t->t_pprev;
+	t->t_next = NULL;
+	t->t_pprev = NULL;
+	ntimers--;
+}
+
+// Re-insert the timers of one slot, which lands them a level lower.
+static void
+cascade(int l, int i)
+{
+	struct Timer *t, *next;
+
+	t = wheel[l][i];
+	wheel[l][i] = NULL;
+	for (; t; t = next) {
+		next = t->t_next;
+		wheel_insert(t);
+	}
+}
+
+// Run the timers that have expired.
+void
+timer_run(void)
+{
+	uint64_t now = clock_ns() >> TIMER_SHIFT;
+	struct Timer *t;
+	int l, i;
+
+	while (ntimers > 0 && wheel_now <= now) {
+		i = wheel_now % WHEEL_SIZE;
+		for (l = 1; l < WHEEL_LEVELS && i == 0; l++) {
+			i = (wheel_now >> (WHEEL_BITS * l)) % WHEEL_SIZE;
+			cascade(l, i);
+		}
+		i = wheel_now % WHEEL_SIZE;
+		while ((t = wheel[0][i]) != NULL) {
+			timer_cancel(t);
+			t->t_fn(t);
+		}
+		wheel_now++;
+	}
+	if (ntimers == 0)
+		wheel_now = now + 1;
+}
+
+// When timer_run next has work: the start of the earliest jiffy any
+// pending timer fires in, in clock_ns() time, or 0 if there are none.
+uint64_t
+timer_next(void)
+{
+	uint64_t next = 0;
+	struct Timer *t;
+	int l, i;
+
+	if (ntimers == 0)
+		return 0;
+	for (l = 0; l < WHEEL_LEVELS; l++)
+		for (i = 0; i < WHEEL_SIZE; i++)
+			for (t = wheel[l][i]; t; t = t->t_next)
+				if (!next || timer_jiffy(t) < next)
+					next = timer_jiffy(t);
+	return next << TIMER_SHIFT;
+}
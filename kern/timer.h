@@ -0,0 +1,16 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_TIMER_H
+#define JOS_KERN_TIMER_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/env.h>
+
+void	timer_add(struct Timer *t, uint64_t expire, void (*fn)(struct Timer *));
+void	timer_cancel(struct Timer *t);
+void	timer_run(void);
+uint64_t timer_next(void);
+
+#endif	// !JOS_KERN_TIMER_H
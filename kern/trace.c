@@ -0,0 +1,81 @@
+// Per-CPU kernel trace rings; see inc/trace.h.
+
+#include <inc/x86.h>
+#include <inc/error.h>
+#include <inc/assert.h>
+
+#include <kern/trace.h>
+#include <kern/pmap.h>
+#include <kern/env.h>
+#include <kern/cpu.h>
+
+// NCPU rings of TRACE_BUFSIZE bytes, allocated in mem_init.
+char *trace_bufs;
+
+static struct TraceBuf *
+trace_buf(int cpu)
+{
+	return (struct TraceBuf *) (trace_bufs + cpu * TRACE_BUFSIZE);
+}
+
+// Called once the page allocator is up.  The rings' pages get a
+// permanent reference, so mapping them into environments and unmapping
+// them again never frees them.
+void
+trace_init(void)
+{
+	int i;
+
+	for (i = 0; i < NCPU * TRACE_BUFSIZE; i += PGSIZE)
+		pa2page(PADDR(trace_bufs + i))->pp_ref = 1;
+	for (i = 0; i < NCPU; i++)
+		trace_buf(i)->tb_cpu = i;
+}
+
+// Record an event on this CPU's ring.  Safe to call without the kernel
+// lock, since nothing else writes this CPU's ring and the kernel runs
+// with interrupts off.
+void
+trace_event(uint32_t type, uint32_t a0, uint32_t a1, uint32_t a2)
+{
+	struct TraceBuf *tb;
+	struct TraceEvent *te;
+
+	if (!trace_bufs)
+		return;
+	tb = trace_buf(cpunum());
+	te = &tb->tb_ev[tb->tb_head % TRACE_NEVENTS];
+	te->te_tsc = read_tsc();
+	te->te_type = type;
+	te->te_envid = curenv ? curenv->env_id : 0;
+	te->te_arg[0] = a0;
+	te->te_arg[1] = a1;
+	te->te_arg[2] = a2;
+	te->te_arg[3] = 0;
+	// The event must be complete before a reader can see it.
+	asm volatile("" : : : "memory");
+	tb->tb_head++;
+}
+
+// Map the rings of all ncpu CPUs read-only at va, one after the other,
+// in pgdir.  Returns 0 or < 0 on error:
+//	-E_INVAL if va isn't page-aligned or the rings wouldn't fit below
+//		UTOP.
+//	-E_NO_MEM if a page table can't be allocated.
+int
+trace_map(pde_t *pgdir, void *va)
+{
+	uintptr_t off;
+	int r;
+
+	if ((uintptr_t) va % PGSIZE || (uintptr_t) va >= UTOP
+	    || UTOP - (uintptr_t) va < ncpu * TRACE_BUFSIZE)
+		return -E_INVAL;
+	for (off = 0; off < ncpu * TRACE_BUFSIZE; off += PGSIZE) {
+		r = page_insert(pgdir, pa2page(PADDR(trace_bufs + off)),
+				(char *) va + off, PTE_U | PTE_P);
+		if (r < 0)
+			return r;
+	}
+	return 0;
+}
@@ -0,0 +1,18 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_TRACE_H
+#define JOS_KERN_TRACE_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/trace.h>
+#include <inc/memlayout.h>
+
+extern char *trace_bufs;
+
+void	trace_init(void);
+void	trace_event(uint32_t type, uint32_t a0, uint32_t a1, uint32_t a2);
+int	trace_map(pde_t *pgdir, void *va);
+
+#endif	// !JOS_KERN_TRACE_H
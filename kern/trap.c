@@ -4,6 +4,10 @@
 
 #include <kern/pmap.h>
 #include <kern/trap.h>
+#include <kern/trace.h>
+#include <kern/stats.h>
+#include <kern/prof.h>
+#include <kern/timer.h>
 #include <kern/console.h>
 #include <kern/monitor.h>
 #include <kern/env.h>
@@ -32,7 +36,7 @@ struct Pseudodesc idt_pd = {
 };
 
 
-static const char *trapname(int trapno)
+const char *trapname(int trapno)
 {
 	static const char * const excnames[] = {
 		"Divide error",
@@ -103,6 +107,7 @@ void trap_irq12();
 void trap_irq13();
 void trap_irq14();
 void trap_irq15();
+void trap_irq_wake();
 
 void
 trap_init(void)
@@ -150,6 +155,7 @@ trap_init(void)
 	SETGATE(idt[IRQ_OFFSET + 13], 0, GD_KT, trap_irq13, 0);
 	SETGATE(idt[IRQ_OFFSET + 14], 0, GD_KT, trap_irq14, 0);
 	SETGATE(idt[IRQ_OFFSET + 15], 0, GD_KT, trap_irq15, 0);
+	SETGATE(idt[IRQ_OFFSET + IRQ_WAKE], 0, GD_KT, trap_irq_wake, 0);
 
 }
 
@@ -270,12 +276,19 @@ trap_dispatch(struct Trapframe *tf)
 	}
 	if(tf->tf_trapno == T_SYSCALL)
 	{
-		tf->tf_regs.reg_eax = syscall(tf->tf_regs.reg_eax,
+		// Blocking system calls don't come back here, so only the
+		// ones that return get a TRACE_SYSCALL event.
+		uint32_t num = tf->tf_regs.reg_eax;
+		uint64_t start = read_tsc();
+
+		tf->tf_regs.reg_eax = syscall(num,
 			tf->tf_regs.reg_edx,
 			tf->tf_regs.reg_ecx,
 			tf->tf_regs.reg_ebx,
 			tf->tf_regs.reg_edi,
 			tf->tf_regs.reg_esi);
+		trace_event(TRACE_SYSCALL, num, read_tsc() - start,
+			    tf->tf_regs.reg_eax);
 		return;
 	}
 
@@ -294,9 +307,19 @@ trap_dispatch(struct Trapframe *tf)
 	if(tf->tf_trapno == IRQ_OFFSET + IRQ_TIMER) // Clock Interrupt
 	{
 		lapic_eoi();
+		timer_run();
+		if (prof_tick(tf))
+			return;
 		sched_yield();
 	}
 
+	// Another CPU made an environment runnable while we were halted.
+	// Returning is enough: trap() will pick something to run.
+	if (tf->tf_trapno == IRQ_OFFSET + IRQ_WAKE) {
+		lapic_eoi();
+		return;
+	}
+
 	// Handle keyboard and serial interrupts.
 	// LAB 5: Your code here.
 	if(tf->tf_trapno == IRQ_OFFSET + IRQ_KBD)
@@ -321,6 +344,22 @@ trap_dispatch(struct Trapframe *tf)
 	}
 }
 
+// Return straight to the context tf was saved from, kernel or user,
+// without any of env_run's bookkeeping.
+static void
+trap_return(struct Trapframe *tf)
+{
+	asm volatile(
+		"\tmovl %0,%%esp\n"
+		"\tpopal\n"
+		"\tpopl %%es\n"
+		"\tpopl %%ds\n"
+		"\taddl $0x8,%%esp\n" /* skip tf_trapno and tf_errcode */
+		"\tiret\n"
+		: : "g" (tf) : "memory");
+	panic("iret failed");
+}
+
 void
 trap(struct Trapframe *tf)
 {
@@ -328,6 +367,14 @@ trap(struct Trapframe *tf)
 	// of GCC rely on DF being clear
 	asm volatile("cld" ::: "cc");
 
+	// A profiling NMI can interrupt the kernel anywhere, even with
+	// the kernel lock held, so take the sample and leave at once.
+	if (tf->tf_trapno == T_NMI && prof_nmi(tf))
+		trap_return(tf);
+
+	stats_trap_enter(tf);
+	trace_event(TRACE_TRAP, tf->tf_trapno, tf->tf_eip, tf->tf_err);
+
 	// Halt the CPU if some other CPU has called panic()
 	extern char *panicstr;
 	if (panicstr)
@@ -335,8 +382,12 @@ trap(struct Trapframe *tf)
 
 	// Re-acqurie the big kernel lock if we were halted in
 	// sched_yield()
-	if (xchg(&thiscpu->cpu_status, CPU_STARTED) == CPU_HALTED)
+	if (xchg(&thiscpu->cpu_status, CPU_STARTED) == CPU_HALTED) {
 		lock_kernel();
+		thiscpu->cpu_idle_cycles += read_tsc() - thiscpu->cpu_halt_tsc;
+		thiscpu->cpu_deadline = 0;
+		lapic_timer_resume();
+	}
 	// Check that interrupts are disabled.  If this assertion
 	// fails, DO NOT be tempted to fix it by inserting a "cli" in
 	// the interrupt path.
@@ -363,6 +414,13 @@ trap(struct Trapframe *tf)
 		curenv->env_tf = *tf;
 		// The trapframe on the stack should be ignored from here on.
 		tf = &curenv->env_tf;
+
+		// Any timeout from the last sleep is moot now.
+		timer_cancel(&curenv->env_timer);
+
+		// It has been in user mode since env_run let it go.
+		curenv->env_utime += thiscpu->cpu_trap_tsc
+			- thiscpu->cpu_user_tsc;
 	}
 
 	// Record that tf is the last real trapframe so
@@ -389,6 +447,7 @@ page_fault_handler(struct Trapframe *tf)
 
 	// Read processor's CR2 register to find the faulting address
 	fault_va = rcr2();
+	trace_event(TRACE_PGFAULT, fault_va, tf->tf_eip, tf->tf_err);
 
 	// Handle kernel-mode page faults.
 
@@ -429,6 +488,12 @@ page_fault_handler(struct Trapframe *tf)
 	//   To change what the user environment runs, modify 'curenv->env_tf'
 	//   (the 'tf' variable points at 'curenv->env_tf').
 
+	// Copy-on-write faults are resolved here rather than by the
+	// environment's handler: spawn maps data pages copy-on-write before
+	// the program has had a chance to install one.
+	if ((tf->tf_err & FEC_WR) && page_cow(curenv->env_pgdir, (void *) fault_va) == 0)
+		return;
+
 	// LAB 4: Your code here.
 	if(curenv->env_pgfault_upcall == NULL)
 	{
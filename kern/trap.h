@@ -19,5 +19,6 @@ void print_regs(struct PushRegs *regs);
 void print_trapframe(struct Trapframe *tf);
 void page_fault_handler(struct Trapframe *);
 void backtrace(struct Trapframe *);
+const char *trapname(int trapno);
 
 #endif /* JOS_KERN_TRAP_H */
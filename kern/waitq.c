@@ -0,0 +1,68 @@
+// Wait queues: the one way for an environment to block in the kernel
+// until something happens.
+//
+// A sleeping environment is ENV_NOT_RUNNABLE and sits on exactly one
+// queue, linked through env_wait_next, so the scheduler never looks at
+// it and waking it costs nothing more than unlinking it.  Everything
+// here runs under the kernel lock.
+
+#include <inc/assert.h>
+
+#include <kern/waitq.h>
+#include <kern/env.h>
+#include <kern/sched.h>
+
+// Put curenv to sleep on wq.  The caller must set up the system call's
+// return value and then give up the CPU with sched_yield.
+void
+waitq_sleep(struct WaitQueue *wq)
+{
+	struct Env **pp;
+
+	assert(curenv && !curenv->env_waitq);
+	for (pp = &wq->wq_head; *pp; pp = &(*pp)->env_wait_next)
+		/* find the tail */;
+	*pp = curenv;
+	curenv->env_wait_next = NULL;
+	curenv->env_waitq = wq;
+	curenv->env_status = ENV_NOT_RUNNABLE;
+}
+
+// Take e off whatever queue it is sleeping on, if any, without
+// waking it.
+void
+waitq_remove(struct Env *e)
+{
+	struct Env **pp;
+
+	if (!e->env_waitq)
+		return;
+	for (pp = &e->env_waitq->wq_head; *pp != e; pp = &(*pp)->env_wait_next)
+		assert(*pp);
+	*pp = e->env_wait_next;
+	e->env_wait_next = NULL;
+	e->env_waitq = NULL;
+}
+
+// Take e off its queue and let it run again.
+void
+waitq_wake_env(struct Env *e)
+{
+	waitq_remove(e);
+	if (e->env_status == ENV_NOT_RUNNABLE) {
+		e->env_status = ENV_RUNNABLE;
+		sched_wake(e, 0);
+	}
+}
+
+// Wake up to n of the environments sleeping on wq, oldest first.
+// Returns the number woken.
+int
+waitq_wakeup(struct WaitQueue *wq, int n)
+{
+	int woken;
+
+	for (woken = 0; wq->wq_head && woken < n; woken++)
+		waitq_wake_env(wq->wq_head);
+	return woken;
+}
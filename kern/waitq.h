@@ -0,0 +1,17 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_WAITQ_H
+#define JOS_KERN_WAITQ_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+#include <inc/env.h>
+
+void	waitq_sleep(struct WaitQueue *wq);
+int	waitq_wakeup(struct WaitQueue *wq, int n);
+void	waitq_wake_env(struct Env *e);
+void	waitq_remove(struct Env *e);
+
+#endif	// !JOS_KERN_WAITQ_H
@@ -75,40 +75,43 @@ opencons(void)
 	return fd2num(fd);
 }
 
+// Console input arrives from the kernel a line (or whatever has been
+// typed so far) at a time; sys_cread sleeps until there is some.
 static ssize_t
 devcons_read(struct Fd *fd, void *vbuf, size_t n)
 {
-	int c;
+	struct FdCons *cons = &fd->fd_cons;
+	char *buf = vbuf;
+	size_t i;
+	int r;
 
 	if (n == 0)
 		return 0;
 
-	while ((c = sys_cgetc()) == 0)
-		sys_yield();
-	if (c < 0)
-		return c;
-	if (c == 0x04)	// ctl-d is eof
+	if (cons->rpos == cons->n) {
+		while ((r = sys_cread(cons->buf, sizeof(cons->buf))) == 0)
+			;
+		if (r < 0)
+			return r;
+		cons->rpos = 0;
+		cons->n = r;
+	}
+	if (cons->buf[cons->rpos] == 0x04) {	// ctl-d is eof
+		cons->rpos++;
 		return 0;
-	*(char*)vbuf = c;
-	return 1;
+	}
+	for (i = 0; i < n && cons->rpos < cons->n
+		     && cons->buf[cons->rpos] != 0x04; i++)
+		buf[i] = cons->buf[cons->rpos++];
+	return i;
 }
 
 static ssize_t
 devcons_write(struct Fd *fd, const void *vbuf, size_t n)
 {
-	int tot, m;
-	char buf[128];
-
-	// mistake: have to nul-terminate arg to sys_cputs,
-	// so we have to copy vbuf into buf in chunks and nul-terminate.
-	for (tot = 0; tot < n; tot += m) {
-		m = n - tot;
-		if (m > sizeof(buf) - 1)
-			m = sizeof(buf) - 1;
-		memmove(buf, (char*)vbuf + tot, m);
-		sys_cputs(buf, m);
-	}
-	return tot;
+	// sys_cputs takes a length, so the data can go as it is.
+	sys_cputs(vbuf, n);
+	return n;
 }
 
 static int
@@ -26,48 +26,31 @@ int execl(const char *prog, const char *arg0, ...)
 	return execv(prog, argv);
 }
 
+// Where execv maps the program file for sys_execv: clear of where
+// programs are linked (see user/user.ld) and of the stack.
+#define EXEC_IMAGE	((void *) 0x3f000000)
+
 int
 execv(const char *prog, const char **argv)
 {
-	void *elf_buf = (void *)0x3f000000;
-	int fd = open(prog, O_RDONLY);
-	if(fd < 0)
-	{
-		panic("error");
-	}
-	struct Stat file_stat;
-	if(fstat(fd, &file_stat) < 0)
-	{
-		panic("error");
-	}
-
-	int r;
-	int elf_size = file_stat.st_size;
-	int buf_size = ROUNDUP(elf_size, PGSIZE);
-	for(int i = 0; i < buf_size / PGSIZE; i++)
-	{
-		r = sys_page_alloc(thisenv->env_id, (void *)((uintptr_t)elf_buf + PGSIZE * i), PTE_U | PTE_W | PTE_P);
-		if(r < 0)
-		{
-			panic("error");
-		}
-	}
-	int left_fsz = elf_size;
-	int buf_p = 0;
-	while (left_fsz > 0)
-	{
-		int read_size = MIN(left_fsz, PGSIZE);
-		r = readn(fd, elf_buf + buf_p ,read_size);
-		if(r != read_size)
-		{
-			panic("error");
-		}
-		buf_p += read_size;
-		left_fsz -=read_size;
+	struct Stat st;
+	int fd, r;
+	off_t i;
+
+	if ((fd = open(prog, O_RDONLY)) < 0)
+		return fd;
+	// The kernel maps the segments straight out of the file's pages in
+	// the block cache; nothing is read.
+	if ((r = fstat(fd, &st)) < 0
+	    || (r = file_map(fd, 0, st.st_size, 0, EXEC_IMAGE, 0)) < 0) {
+		close(fd);
+		return r;
 	}
 	close(fd);
-	sys_execv(elf_buf, elf_size, argv);
-	panic("error");
-	return -1;
-}
+	r = sys_execv(EXEC_IMAGE, st.st_size, argv);
 
+	// Still here, so it failed.
+	for (i = 0; i < st.st_size; i += PGSIZE)
+		sys_page_unmap(0, EXEC_IMAGE + i);
+	return r;
+}
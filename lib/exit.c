@@ -1,10 +1,17 @@
 
 #include <inc/lib.h>
 
+// Exit with 'status', which a parent sees in wait_status or wait_any.
 void
-exit(void)
+exit_status(int status)
 {
 	close_all();
-	sys_env_destroy(0);
+	sys_env_exit(status);
+}
+
+void
+exit(void)
+{
+	exit_status(0);
 }
 
@@ -183,6 +183,31 @@ devfile_trunc(struct Fd *fd, off_t newsize)
 }
 
 
+// Map the pages holding n bytes of file fdnum, starting at the
+// page-aligned offset, straight from the file server's block cache into
+// envid (0 for ourselves, otherwise one of our children) at va.  The
+// pages are shared with the cache: read-only, or copy-on-write if perm
+// includes PTE_COW.  Later changes to the file don't show through.
+int
+file_map(int fdnum, off_t offset, size_t n, envid_t envid, void *va, int perm)
+{
+	struct Fd *fd;
+	int r;
+
+	if ((r = fd_lookup(fdnum, &fd)) < 0)
+		return r;
+	if (fd->fd_dev_id != devfile.dev_id)
+		return -E_INVAL;
+	fsipcbuf.map.req_fileid = fd->fd_file.id;
+	fsipcbuf.map.req_offset = offset;
+	fsipcbuf.map.req_n = n;
+	fsipcbuf.map.req_envid = envid;
+	fsipcbuf.map.req_va = (uintptr_t) va;
+	fsipcbuf.map.req_perm = perm;
+	return fsipc(FSREQ_MAP, NULL);
+}
+
+
 // Synchronize disk with buffer cache
 int
 sync(void)
@@ -193,3 +218,15 @@ sync(void)
 	return fsipc(FSREQ_SYNC, NULL);
 }
 
+
+// Fetch the file system's block usage and fragmentation report.
+int
+statfs(struct Fsret_statfs *st)
+{
+	int r;
+
+	if ((r = fsipc(FSREQ_STATFS, NULL)) < 0)
+		return r;
+	*st = fsipcbuf.statfsRet;
+	return 0;
+}
@@ -21,9 +21,18 @@
 //   a perfectly valid place to map a page.)
 int32_t
 ipc_recv(envid_t *from_env_store, void *pg, int *perm_store)
+{
+	return ipc_recv_timeout(from_env_store, pg, perm_store, 0);
+}
+
+// Like ipc_recv, but give up and return -E_TIMEOUT if nothing arrives
+// within ns nanoseconds.  A zero ns waits forever.
+int32_t
+ipc_recv_timeout(envid_t *from_env_store, void *pg, int *perm_store,
+		 uint64_t ns)
 {
 	// LAB 4: Your code here.
-	int err = sys_ipc_recv(pg ? pg : (void *)-1);
+	int err = sys_ipc_recv_timeout(pg ? pg : (void *)-1, ns);
 	if(err)
 	{
 		if(from_env_store)
@@ -71,14 +80,51 @@ ipc_send(envid_t to_env, uint32_t val, void *pg, int perm)
 }
 
 // Find the first environment of the given type.  We'll use this to
-// find special environments.
+// find special environments.  The answer is remembered for each type,
+// and envs[] is only searched again once that environment is gone.
 // Returns 0 if no such environment exists.
 envid_t
 ipc_find_env(enum EnvType type)
 {
-	int i;
-	for (i = 0; i < NENV; i++)
-		if (envs[i].env_type == type)
+	static envid_t found[ENV_NTYPES];
+	const volatile struct Env *e;
+	int i, n;
+
+	if (type < ENV_NTYPES && found[type]) {
+		e = &envs[ENVX(found[type])];
+		if (e->env_id == found[type] && e->env_type == type
+		    && e->env_status != ENV_FREE)
+			return found[type];
+	}
+	n = envs_mapped();
+	for (i = 0; i < n; i++)
+		if (envs[i].env_type == type) {
+			if (type < ENV_NTYPES)
+				found[type] = envs[i].env_id;
 			return envs[i].env_id;
+		}
 	return 0;
 }
+
+// The number of slots at the start of envs[] that can be looked at.
+// The kernel maps envs[] a page at a time as the table grows, so the
+// mapped pages are always a prefix of UENVS; find its end by binary
+// search.
+int
+envs_mapped(void)
+{
+	uintptr_t va;
+	int lo = 0, hi = (NENV * sizeof(struct Env) + PGSIZE - 1) / PGSIZE;
+	int mid;
+
+	// Invariant: pages below lo are mapped, pages from hi on are not.
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		va = UENVS + mid * PGSIZE;
+		if ((uvpd[PDX(va)] & PTE_P) && (uvpt[PGNUM(va)] & PTE_P))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return MIN(lo * PGSIZE / sizeof(struct Env), NENV);
+}
@@ -17,11 +17,17 @@ struct Dev devpipe =
 	.dev_stat =	devpipe_stat,
 };
 
-#define PIPEBUFSIZ 32		// small to provoke races
+// The ring buffer fills the rest of the pipe's shared page.
+// Positions count modulo PIPEPOSMOD, twice the buffer size, so that a
+// full pipe and an empty one look different.
+#define PIPEBUFSIZ	(PGSIZE - 4 * sizeof(uint32_t))
+#define PIPEPOSMOD	(2 * PIPEBUFSIZ)
 
 struct Pipe {
-	off_t p_rpos;		// read position
-	off_t p_wpos;		// write position
+	volatile uint32_t p_rpos;	// read position
+	volatile uint32_t p_wpos;	// write position
+	volatile uint32_t p_rsleep;	// a reader is asleep on p_wpos
+	volatile uint32_t p_wsleep;	// a writer is asleep on p_rpos
 	uint8_t p_buf[PIPEBUFSIZ];	// data buffer
 };
 
@@ -101,11 +107,45 @@ pipeisclosed(int fdnum)
 	return _pipeisclosed(fd, p);
 }
 
+static uint32_t
+pipe_used(uint32_t rpos, uint32_t wpos)
+{
+	return (wpos + PIPEPOSMOD - rpos) % PIPEPOSMOD;
+}
+
+// Sleep until the other end moves *pos away from 'old' (the value the
+// caller found), or until the pipe page loses a mapping, which is how
+// the other end closing shows up.  'ref' is the page's reference count
+// the caller saw while deciding the pipe wasn't closed; the kernel
+// won't put us to sleep if it has changed since.
+static void
+pipe_sleep(volatile uint32_t *pos, uint32_t old, volatile uint32_t *sleeping,
+	   int ref)
+{
+	*sleeping = 1;
+	// Publish *sleeping before the kernel rechecks *pos; pairs with
+	// the barrier in pipe_wake.
+	__sync_synchronize();
+	sys_futex_wait(pos, old, ref);
+}
+
+// We just moved *pos; wake anyone sleeping on it.
+static void
+pipe_wake(volatile uint32_t *pos, volatile uint32_t *sleeping)
+{
+	__sync_synchronize();
+	if (*sleeping) {
+		*sleeping = 0;
+		sys_futex_wake(pos, NENV);
+	}
+}
+
 static ssize_t
 devpipe_read(struct Fd *fd, void *vbuf, size_t n)
 {
 	uint8_t *buf;
-	size_t i;
+	uint32_t rpos, wpos, m, off;
+	int ref;
 	struct Pipe *p;
 
 	p = (struct Pipe*)fd2data(fd);
@@ -113,33 +153,40 @@ devpipe_read(struct Fd *fd, void *vbuf, size_t n)
 		cprintf("[%08x] devpipe_read %08x %d rpos %d wpos %d\n",
 			thisenv->env_id, uvpt[PGNUM(p)], n, p->p_rpos, p->p_wpos);
 
-	buf = vbuf;
-	for (i = 0; i < n; i++) {
-		while (p->p_rpos == p->p_wpos) {
-			// pipe is empty
-			// if we got any data, return it
-			if (i > 0)
-				return i;
-			// if all the writers are gone, note eof
-			if (_pipeisclosed(fd, p))
-				return 0;
-			// yield and see what happens
-			if (debug)
-				cprintf("devpipe_read yield\n");
-			sys_yield();
-		}
-		// there's a byte.  take it.
-		// wait to increment rpos until the byte is taken!
-		buf[i] = p->p_buf[p->p_rpos % PIPEBUFSIZ];
-		p->p_rpos++;
+	while (1) {
+		ref = pageref(p);
+		rpos = p->p_rpos;
+		wpos = p->p_wpos;
+		if (pipe_used(rpos, wpos) > 0)
+			break;
+		// pipe is empty
+		// if all the writers are gone, note eof
+		if (_pipeisclosed(fd, p))
+			return 0;
+		if (debug)
+			cprintf("devpipe_read sleep\n");
+		pipe_sleep(&p->p_wpos, wpos, &p->p_rsleep, ref);
 	}
-	return i;
+
+	// Take what's there, in at most two pieces if it wraps.
+	// wait to advance rpos until the bytes are taken!
+	buf = vbuf;
+	n = MIN(n, pipe_used(rpos, wpos));
+	off = rpos % PIPEBUFSIZ;
+	m = MIN(n, PIPEBUFSIZ - off);
+	memcpy(buf, p->p_buf + off, m);
+	memcpy(buf + m, p->p_buf, n - m);
+	p->p_rpos = (rpos + n) % PIPEPOSMOD;
+	pipe_wake(&p->p_rpos, &p->p_wsleep);
+	return n;
 }
 
 static ssize_t
 devpipe_write(struct Fd *fd, const void *vbuf, size_t n)
 {
 	const uint8_t *buf;
+	uint32_t rpos, wpos, m, off, room;
+	int ref;
 	size_t i;
 	struct Pipe *p;
 
@@ -149,23 +196,33 @@ devpipe_write(struct Fd *fd, const void *vbuf, size_t n)
 			thisenv->env_id, uvpt[PGNUM(p)], n, p->p_rpos, p->p_wpos);
 
 	buf = vbuf;
-	for (i = 0; i < n; i++) {
-		while (p->p_wpos >= p->p_rpos + sizeof(p->p_buf)) {
+	for (i = 0; i < n; i += room) {
+		ref = pageref(p);
+		rpos = p->p_rpos;
+		wpos = p->p_wpos;
+		if ((room = PIPEBUFSIZ - pipe_used(rpos, wpos)) == 0) {
 			// pipe is full
 			// if all the readers are gone
 			// (it's only writers like us now),
 			// note eof
 			if (_pipeisclosed(fd, p))
 				return 0;
-			// yield and see what happens
 			if (debug)
-				cprintf("devpipe_write yield\n");
-			sys_yield();
+				cprintf("devpipe_write sleep\n");
+			pipe_sleep(&p->p_rpos, rpos, &p->p_wsleep, ref);
+			room = 0;
+			continue;
 		}
-		// there's room for a byte.  store it.
-		// wait to increment wpos until the byte is stored!
-		p->p_buf[p->p_wpos % PIPEBUFSIZ] = buf[i];
-		p->p_wpos++;
+
+		// Store as much as fits, in at most two pieces.
+		// wait to advance wpos until the bytes are stored!
+		room = MIN(room, n - i);
+		off = wpos % PIPEBUFSIZ;
+		m = MIN(room, PIPEBUFSIZ - off);
+		memcpy(p->p_buf + off, buf + i, m);
+		memcpy(p->p_buf, buf + i + m, room - m);
+		p->p_wpos = (wpos + room) % PIPEPOSMOD;
+		pipe_wake(&p->p_wpos, &p->p_rsleep);
 	}
 
 	return i;
@@ -176,7 +233,7 @@ devpipe_stat(struct Fd *fd, struct Stat *stat)
 {
 	struct Pipe *p = (struct Pipe*) fd2data(fd);
 	strcpy(stat->st_name, "<pipe>");
-	stat->st_size = p->p_wpos - p->p_rpos;
+	stat->st_size = pipe_used(p->p_rpos, p->p_wpos);
 	stat->st_isdir = 0;
 	stat->st_dev = &devpipe;
 	return 0;
@@ -261,12 +261,19 @@ error:
 	return r;
 }
 
+// Nothing is read from the file.  The segment's file data is mapped
+// straight from the file server's block cache with one request, so
+// every instance of a program shares the same pages: read-only ones
+// for text, and copy-on-write ones for data, which the kernel copies
+// only when the child first writes them.  The server zero-fills the
+// page where the file data ends and shares that too.  The bss is one
+// zeroed page mapped copy-on-write throughout.
 static int
 map_segment(envid_t child, uintptr_t va, size_t memsz,
 	int fd, size_t filesz, off_t fileoffset, int perm)
 {
-	int i, r;
-	void *blk;
+	int i, r, zperm;
+	bool zero = 0;
 
 	//cprintf("map_segment %x+%x\n", va, memsz);
 
@@ -277,25 +284,26 @@ map_segment(envid_t child, uintptr_t va, size_t memsz,
 		fileoffset -= i;
 	}
 
-	for (i = 0; i < memsz; i += PGSIZE) {
-		if (i >= filesz) {
-			// allocate a blank page
-			if ((r = sys_page_alloc(child, (void*) (va + i), perm)) < 0)
-				return r;
-		} else {
-			// from file
-			if ((r = sys_page_alloc(0, UTEMP, PTE_P|PTE_U|PTE_W)) < 0)
-				return r;
-			if ((r = seek(fd, fileoffset + i)) < 0)
-				return r;
-			if ((r = readn(fd, UTEMP, MIN(PGSIZE, filesz-i))) < 0)
+	zperm = perm & PTE_W ? PTE_P | PTE_U | PTE_COW : perm;
+	if (filesz > 0 && (r = file_map(fd, fileoffset, filesz, child, (void*) va,
+					zperm & PTE_COW)) < 0)
+		return r;
+
+	for (i = ROUNDUP(filesz, PGSIZE); i < memsz; i += PGSIZE) {
+		// share a blank page
+		if (!zero) {
+			if ((r = sys_page_alloc(0, UTEMP2, PTE_P|PTE_U|PTE_W)) < 0)
 				return r;
-			if ((r = sys_page_map(0, UTEMP, child, (void*) (va + i), perm)) < 0)
-				panic("spawn: sys_page_map data: %e", r);
-			sys_page_unmap(0, UTEMP);
+			zero = 1;
 		}
+		if ((r = sys_page_map(0, UTEMP2, child, (void*) (va + i), zperm)) < 0)
+			goto out;
 	}
-	return 0;
+	r = 0;
+out:
+	if (zero)
+		sys_page_unmap(0, UTEMP2);
+	return r;
 }
 
 // Copy the mappings for shared pages into the child address space.
@@ -40,7 +40,16 @@ syscall(int num, int check, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4,
 void
 sys_cputs(const char *s, size_t len)
 {
-	syscall(SYS_cputs, 0, (uint32_t)s, len, 0, 0, 0);
+	int r;
+
+	// The kernel queues what it can and sleeps when the queue is full.
+	while (len > 0) {
+		r = syscall(SYS_cputs, 0, (uint32_t)s, len, 0, 0, 0);
+		if (r < 0)
+			break;
+		s += r;
+		len -= r;
+	}
 }
 
 int
@@ -118,8 +127,133 @@ sys_ipc_recv(void *dstva)
 }
 
 int
-sys_execv(void *elf_buf, uint32_t elf_size, const char **argv)
+sys_ipc_recv_timeout(void *dstva, uint64_t ns)
+{
+	return syscall(SYS_ipc_recv, 0, (uint32_t) dstva, (uint32_t) ns,
+		       (uint32_t) (ns >> 32), 0, 0);
+}
+
+int
+sys_futex_wait(const volatile uint32_t *addr, uint32_t val, int pgref)
+{
+	return syscall(SYS_futex_wait, 0, (uint32_t) addr, val, pgref, 0, 0);
+}
+
+int
+sys_futex_wait_timeout(const volatile uint32_t *addr, uint32_t val, int pgref,
+		       uint64_t ns)
+{
+	return syscall(SYS_futex_wait, 0, (uint32_t) addr, val, pgref,
+		       (uint32_t) ns, (uint32_t) (ns >> 32));
+}
+
+int
+sys_futex_wake(const volatile uint32_t *addr, int n)
+{
+	return syscall(SYS_futex_wake, 0, (uint32_t) addr, n, 0, 0, 0);
+}
+
+int
+sys_idle_cycles(uint64_t *cycles)
+{
+	return syscall(SYS_idle_cycles, 0, (uint32_t) cycles, 0, 0, 0, 0);
+}
+
+void
+sys_env_exit(int status)
+{
+	syscall(SYS_env_exit, 0, status, 0, 0, 0, 0);
+}
+
+int
+sys_wait(envid_t envid, int *status)
+{
+	return syscall(SYS_wait, 0, envid, (uint32_t) status, 0, 0, 0);
+}
+
+envid_t
+sys_wait_any(int *status)
+{
+	return syscall(SYS_wait_any, 0, (uint32_t) status, 0, 0, 0, 0);
+}
+
+int
+sys_cread(char *buf, size_t n)
+{
+	return syscall(SYS_cread, 0, (uint32_t) buf, n, 0, 0, 0);
+}
+
+int
+sys_trace_map(void *va)
+{
+	return syscall(SYS_trace_map, 0, (uint32_t) va, 0, 0, 0, 0);
+}
+
+int
+sys_stats(int cpu, struct Stats *st)
+{
+	return syscall(SYS_stats, 0, cpu, (uint32_t) st, 0, 0, 0);
+}
+
+int
+sys_prof_ctl(uint32_t period)
+{
+	return syscall(SYS_prof_ctl, 0, period, 0, 0, 0, 0);
+}
+
+int
+sys_prof_read(struct ProfSample *buf, int n, uint32_t *lost)
+{
+	return syscall(SYS_prof_read, 0, (uint32_t) buf, n, (uint32_t) lost,
+		       0, 0);
+}
+
+int
+sys_ksym(uintptr_t eip, char *name, size_t len)
+{
+	return syscall(SYS_ksym, 0, eip, (uint32_t) name, len, 0, 0);
+}
+
+int
+sys_time_ns(uint64_t *ns)
+{
+	return syscall(SYS_time_ns, 0, (uint32_t) ns, 0, 0, 0, 0);
+}
+
+int
+sys_sleep_ns(uint64_t ns)
+{
+	return syscall(SYS_sleep_ns, 0, (uint32_t) ns, (uint32_t) (ns >> 32),
+		       0, 0, 0);
+}
+
+int
+sys_env_set_priority(envid_t envid, int prio)
+{
+	return syscall(SYS_env_set_priority, 0, envid, prio, 0, 0, 0);
+}
+
+int
+sys_env_set_affinity(envid_t envid, uint32_t mask)
+{
+	return syscall(SYS_env_set_affinity, 0, envid, mask, 0, 0, 0);
+}
+
+int
+sys_env_stat(envid_t envid, struct EnvStat *st)
+{
+	return syscall(SYS_env_stat, 0, envid, (uint32_t) st, 0, 0, 0);
+}
+
+int
+sys_pages_free(void)
+{
+	return syscall(SYS_pages_free, 0, 0, 0, 0, 0, 0);
+}
+
+int
+sys_execv(void *image, uint32_t size, const char **argv)
 {
-	return syscall(SYS_execv, 0, (uint32_t)elf_buf, elf_size, (uint32_t)argv, 0, 0);
+	return syscall(SYS_execv, 0, (uint32_t)image, size, (uint32_t)argv, 0, 0);
 }
 
@@ -4,10 +4,32 @@
 void
 wait(envid_t envid)
 {
-	const volatile struct Env *e;
-
 	assert(envid != 0);
-	e = &envs[ENVX(envid)];
-	while (e->env_id == envid && e->env_status != ENV_FREE)
-		sys_yield();
+	wait_status(envid, NULL);
+}
+
+// Waits until 'envid' exits and stores its exit status in *status.
+// Returns envid, or < 0 if there is no such environment (including
+// when it exited earlier and its parent already waited for it).
+int
+wait_status(envid_t envid, int *status)
+{
+	int r;
+
+	// sys_wait returns 0 after sleeping; ask again.
+	while ((r = sys_wait(envid, status)) == 0)
+		;
+	return r;
+}
+
+// Waits until any child exits and stores its exit status in *status.
+// Returns the child's envid, or < 0 if there are no children.
+envid_t
+wait_any(int *status)
+{
+	envid_t r;
+
+	while ((r = sys_wait_any(status)) == 0)
+		;
+	return r;
 }
@@ -0,0 +1,52 @@
+// Time printing a file to the console: "consbench [kilobytes]" writes
+// a file of that size (default 1024) if it isn't there already, then
+// times "cat" of it and reports how much of that the CPUs were idle.
+// cat is done once its output is queued, so the serial line may still
+// be busy when the time is taken.
+
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+#define FILE	"/consbench.txt"
+
+static void
+make_file(int size)
+{
+	char line[80];
+	struct Stat st;
+	int fd, n, r;
+
+	if (stat(FILE, &st) == 0 && st.st_size == size)
+		return;
+	if ((fd = open(FILE, O_WRONLY|O_CREAT|O_TRUNC)) < 0)
+		panic("open %s: %e", FILE, fd);
+	for (n = 0; n < size; n += r) {
+		snprintf(line, sizeof(line), "%08d the quick brown fox jumps over the lazy dog\n", n);
+		if ((r = write(fd, line, MIN(strlen(line), size - n))) < 0)
+			panic("write %s: %e", FILE, r);
+	}
+	close(fd);
+}
+
+void
+umain(int argc, char **argv)
+{
+	uint64_t idle0, idle1, start, elapsed;
+	int size, ncpu;
+	envid_t pid;
+
+	binaryname = "consbench";
+	size = (argc > 1 ? strtol(argv[1], 0, 0) : 1024) * 1024;
+	make_file(size);
+
+	sys_idle_cycles(&idle0);
+	start = read_tsc();
+	if ((pid = spawnl("/cat", "cat", FILE, 0)) < 0)
+		panic("spawn cat: %e", pid);
+	wait(pid);
+	ncpu = sys_idle_cycles(&idle1);
+	elapsed = read_tsc() - start;
+
+	cprintf("\ncat of %d bytes: %llu cycles, %llu%% idle\n", size, elapsed,
+		(idle1 - idle0) * 100 / (elapsed * ncpu));
+}
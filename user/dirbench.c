@@ -0,0 +1,83 @@
+// Time open() of existing and missing names after adding 10, 1000 and
+// 10000 entries to the root directory.  With a hashed directory each
+// lookup walks one short chain, so the cost should stay flat; a linear
+// directory gets slower with every entry added.
+//
+// The disk may fill up before the largest size is reached; the
+// benchmark then reports the sizes it managed.  The files it creates
+// are empty and are left behind.
+
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+#define NROUNDS	200
+
+static int nfiles;
+
+static void
+name(char *buf, int i)
+{
+	snprintf(buf, MAXNAMELEN, "/dirbench.%d", i);
+}
+
+// Create files until nfiles reaches n.  Returns 0, or < 0 on error.
+static int
+grow(int n)
+{
+	char buf[MAXNAMELEN];
+	int fd;
+
+	for (; nfiles < n; nfiles++) {
+		name(buf, nfiles);
+		if ((fd = open(buf, O_RDONLY|O_CREAT)) < 0)
+			return fd;
+		close(fd);
+	}
+	return 0;
+}
+
+// Average cycles for one open()/close() of existing names, or of
+// names that don't exist when 'miss' is set.
+static uint64_t
+time_open(bool miss)
+{
+	char buf[MAXNAMELEN];
+	uint64_t start;
+	int i, fd;
+
+	start = read_tsc();
+	for (i = 0; i < NROUNDS; i++) {
+		name(buf, miss ? nfiles + i : (i * 7919) % nfiles);
+		fd = open(buf, O_RDONLY);
+		if (!miss && fd < 0)
+			panic("open %s: %e", buf, fd);
+		if (miss && fd != -E_NOT_FOUND)
+			panic("open %s: got %e", buf, fd);
+		if (fd >= 0)
+			close(fd);
+	}
+	return (read_tsc() - start) / NROUNDS;
+}
+
+void
+umain(int argc, char **argv)
+{
+	static const int sizes[] = { 10, 1000, 10000 };
+	uint64_t hit, miss;
+	int i, r;
+
+	binaryname = "dirbench";
+	for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+		if ((r = grow(sizes[i])) < 0)
+			printf("stopped at %d entries: %e\n", nfiles, r);
+		if (nfiles == 0)
+			break;
+		hit = time_open(0);
+		miss = time_open(1);
+		printf("%d entries: open %llu cycles, missing name %llu cycles\n",
+		       nfiles, hit, miss);
+		if (r < 0)
+			break;
+	}
+	sync();
+}
@@ -0,0 +1,48 @@
+// Check that a directory can keep growing: add NFILES entries to the
+// root directory, far more than one journal transaction could cover if
+// each addition reserved room for the whole directory, then make sure
+// every one of them opens as the file of that name, and that a name
+// never created is still not found.  The files are empty, to fit on
+// the disk, and are left behind.
+
+#include <inc/lib.h>
+
+#define NFILES	1100
+
+static void
+name(char *buf, int i)
+{
+	snprintf(buf, MAXNAMELEN, "/dirtest.%d", i);
+}
+
+void
+umain(int argc, char **argv)
+{
+	char buf[MAXNAMELEN];
+	struct Stat st;
+	int i, r, fd;
+
+	binaryname = "dirtest";
+	for (i = 0; i < NFILES; i++) {
+		name(buf, i);
+		if ((fd = open(buf, O_RDONLY|O_CREAT)) < 0)
+			panic("create %s: %e", buf, fd);
+		close(fd);
+	}
+	sync();
+
+	for (i = 0; i < NFILES; i++) {
+		name(buf, i);
+		if ((fd = open(buf, O_RDONLY)) < 0)
+			panic("open %s: %e", buf, fd);
+		if ((r = fstat(fd, &st)) < 0)
+			panic("stat %s: %e", buf, r);
+		if (strcmp(st.st_name, buf + 1) != 0)
+			panic("%s opened %s", buf, st.st_name);
+		close(fd);
+	}
+	name(buf, NFILES);
+	if ((fd = open(buf, O_RDONLY)) != -E_NOT_FOUND)
+		panic("open %s: got %e", buf, fd);
+	printf("dirtest: %d entries OK\n", NFILES);
+}
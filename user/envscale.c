@@ -0,0 +1,51 @@
+// Create environments until there are tens of thousands (or memory runs
+// out), timing sys_exofork for each batch of 1000.  The environment
+// table grows as it fills and env_alloc finds a free slot without
+// searching the whole table, so the per-fork cost should stay flat.
+// The children never run; they are destroyed and reaped at the end.
+//
+//	envscale [count]
+
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+#define BATCH	1000
+
+void
+umain(int argc, char **argv)
+{
+	int target = 20000, n = 0, i, me;
+	uint64_t start;
+	envid_t child = 0;
+
+	binaryname = "envscale";
+	if (argc > 1)
+		target = strtol(argv[1], NULL, 0);
+
+	while (n < target) {
+		start = read_tsc();
+		for (i = 0; i < BATCH && n < target; i++, n++)
+			if ((child = sys_exofork()) < 0)
+				break;
+		if (i > 0)
+			printf("%6d envs: %llu cycles per fork\n", n,
+			       (read_tsc() - start) / i);
+		if (child < 0) {
+			printf("stopped at %d: %e\n", n, child);
+			break;
+		}
+	}
+
+	me = sys_getenvid();
+	start = read_tsc();
+	n = envs_mapped();
+	for (i = 0; i < n; i++)
+		if (envs[i].env_parent_id == me
+		    && envs[i].env_status != ENV_FREE) {
+			child = envs[i].env_id;
+			sys_env_destroy(child);
+			sys_wait(child, NULL);
+		}
+	printf("%d slots in the table; cleanup took %llu cycles\n", n,
+	       read_tsc() - start);
+}
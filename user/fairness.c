@@ -1,25 +1,74 @@
-// Demonstrate lack of fairness in IPC.
-// Start three instances of this program as envs 1, 2, and 3.
-// (user/idle is env 0).
+// Show how the scheduler shares the CPU.  Four CPU-bound children run
+// at priorities 0, 0, 5 and -5; between them their shares of the CPU
+// should follow their weights, about 1 : 1 : 1/3 : 3 (on a single CPU;
+// with more CPUs than children everyone just gets a CPU).  Meanwhile
+// the parent times small file system requests, which the file server's
+// priority and the IPC wakeup boost should keep prompt despite the load.
 
 #include <inc/lib.h>
 
+#define NROUNDS		200
+
+static const int prios[] = { 0, 0, 5, -5 };
+
+// Time NROUNDS stat() calls, 1ms apart.
+static void
+time_fs(const char *what)
+{
+	struct Stat st;
+	uint64_t t, min = ~0ULL, max = 0, total = 0;
+	int i, r;
+
+	for (i = 0; i < NROUNDS; i++) {
+		t = time_ns();
+		if ((r = stat("/motd", &st)) < 0)
+			panic("stat /motd: %e", r);
+		t = time_ns() - t;
+		total += t;
+		min = MIN(min, t);
+		max = MAX(max, t);
+		sys_sleep_ns(1000000);
+	}
+	cprintf("stat %s: min %llu us, avg %llu us, max %llu us\n",
+		what, min / 1000, total / NROUNDS / 1000, max / 1000);
+}
+
 void
 umain(int argc, char **argv)
 {
-	envid_t who, id;
+	envid_t kids[ARRAY_SIZE(prios)];
+	uint64_t start[ARRAY_SIZE(prios)], used[ARRAY_SIZE(prios)], total;
+	int i, r;
 
-	id = sys_getenvid();
+	binaryname = "fairness";
+	time_fs("idle");
 
-	if (thisenv == &envs[1]) {
-		while (1) {
-			ipc_recv(&who, 0, 0);
-			cprintf("%x recv from %x\n", id, who);
+	for (i = 0; i < ARRAY_SIZE(prios); i++) {
+		if ((kids[i] = fork()) < 0)
+			panic("fork: %e", kids[i]);
+		if (kids[i] == 0) {
+			if ((r = sys_env_set_priority(0, prios[i])) < 0)
+				panic("sys_env_set_priority: %e", r);
+			while (1)
+				/* do nothing */;
 		}
-	} else {
-		cprintf("%x loop sending to %x\n", id, envs[1].env_id);
-		while (1)
-			ipc_send(envs[1].env_id, 0, 0, 0);
 	}
-}
+	sys_sleep_ns(10000000);
+
+	for (i = 0; i < ARRAY_SIZE(prios); i++)
+		start[i] = envs[ENVX(kids[i])].env_runtime;
+	time_fs("under load");
+	sys_sleep_ns(500000000);
+	total = 0;
+	for (i = 0; i < ARRAY_SIZE(prios); i++) {
+		used[i] = envs[ENVX(kids[i])].env_runtime - start[i];
+		total += used[i];
+	}
 
+	for (i = 0; i < ARRAY_SIZE(prios); i++) {
+		cprintf("%08x priority %3d: %3llu%% of the children's CPU time\n",
+			kids[i], prios[i], total ? used[i] * 100 / total : 0);
+		sys_env_destroy(kids[i]);
+		wait(kids[i]);
+	}
+}
@@ -0,0 +1,78 @@
+// Fill the disk by appending page-sized chunks to two files in
+// turn, then report the cost per allocated block and how fragmented
+// the files ended up.  Interleaving the writers is the worst case for
+// a first-fit allocator, which alternates their blocks; the average
+// extent length of the two files shows how well the per-file
+// placement goals keep them apart.
+
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+char buf[PGSIZE];
+
+// Append one whole block to fd.  A single write() moves at most a
+// request page's worth of data, which is a little less than a block.
+static int
+writeblock(int fd)
+{
+	int n, r;
+
+	for (n = 0; n < sizeof(buf); n += r)
+		if ((r = write(fd, buf + n, sizeof(buf) - n)) < 0)
+			return r;
+	return n;
+}
+
+// Print the file system's fragmentation report and return the number
+// of extents the files in the root are made of.
+static int
+report(const char *when)
+{
+	struct Fsret_statfs st;
+	int r;
+
+	if ((r = statfs(&st)) < 0)
+		panic("statfs: %e", r);
+	printf("%s: %d/%d blocks free in %d runs; %d files, %d extents\n",
+	       when, st.ret_nfree, st.ret_nblocks, st.ret_nfreeext,
+	       st.ret_nfiles, st.ret_nfileext);
+	return st.ret_nfileext;
+}
+
+void
+umain(int argc, char **argv)
+{
+	int fd[2], i, r, nblocks, next;
+	uint64_t start, cycles;
+
+	binaryname = "fsfill";
+	next = report("before");
+
+	for (i = 0; i < 2; i++) {
+		const char *path = i ? "/fill.b" : "/fill.a";
+		if ((fd[i] = open(path, O_WRONLY|O_CREAT|O_TRUNC)) < 0)
+			panic("open %s: %e", path, fd[i]);
+	}
+
+	memset(buf, 0xAA, sizeof(buf));
+	nblocks = 0;
+	start = read_tsc();
+	for (i = 0; (r = writeblock(fd[i])) >= 0; i ^= 1)
+		nblocks++;
+	cycles = read_tsc() - start;
+	if (r != -E_NO_DISK)
+		panic("write: %e", r);
+
+	printf("%d blocks in %llu cycles, %llu cycles/block\n",
+	       nblocks, cycles, nblocks ? cycles / nblocks : 0);
+	next = report("full") - next;
+	printf("fill files: %d blocks in %d extents, %d blocks per extent\n",
+	       nblocks, next, next ? nblocks / next : 0);
+
+	for (i = 0; i < 2; i++) {
+		ftruncate(fd[i], 0);
+		close(fd[i]);
+	}
+	sync();
+	report("after");
+}
@@ -0,0 +1,34 @@
+// Print the file system's block usage and fragmentation report, and
+// the file server's name cache statistics.
+
+#include <inc/lib.h>
+
+void
+umain(int argc, char **argv)
+{
+	struct Fsret_statfs st;
+	int r, total;
+
+	binaryname = "fsfrag";
+	if ((r = statfs(&st)) < 0)
+		panic("statfs: %e", r);
+
+	printf("blocks: %d total, %d free\n", st.ret_nblocks, st.ret_nfree);
+	printf("free space: %d runs, longest %d blocks\n",
+	       st.ret_nfreeext, st.ret_maxfreeext);
+	printf("files: %d in /, %d extents", st.ret_nfiles, st.ret_nfileext);
+	if (st.ret_nfiles)
+		printf(" (%d.%02d per file)",
+		       st.ret_nfileext / st.ret_nfiles,
+		       st.ret_nfileext * 100 / st.ret_nfiles % 100);
+	printf("\n");
+
+	total = st.ret_dchits + st.ret_dcneghits + st.ret_dcmisses;
+	printf("name cache: %d hits (%d negative), %d misses",
+	       st.ret_dchits + st.ret_dcneghits, st.ret_dcneghits,
+	       st.ret_dcmisses);
+	if (total)
+		printf(", %d%% hit rate",
+		       (st.ret_dchits + st.ret_dcneghits) * 100 / total);
+	printf("\n");
+}
@@ -0,0 +1,31 @@
+// Run a command and report how much of the time the CPUs spent halted
+// while it ran.  "idlestat sh bgjobs.sh" measures a shell session with
+// background jobs; anything that sleeps rather than spins (wait(),
+// pipes) shows up as idle time.
+
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+void
+umain(int argc, char **argv)
+{
+	uint64_t idle0, idle1, start, elapsed;
+	int r, ncpu;
+
+	binaryname = "idlestat";
+	if (argc < 2) {
+		printf("usage: idlestat command [args...]\n");
+		exit();
+	}
+
+	sys_idle_cycles(&idle0);
+	start = read_tsc();
+	if ((r = spawn(argv[1], (const char **) argv + 1)) < 0)
+		panic("spawn %s: %e", argv[1], r);
+	wait(r);
+	ncpu = sys_idle_cycles(&idle1);
+	elapsed = read_tsc() - start;
+
+	printf("%llu cycles on %d cpus, %llu%% idle\n", elapsed, ncpu,
+	       (idle1 - idle0) * 100 / (elapsed * ncpu));
+}
@@ -0,0 +1,102 @@
+// Print the kernel's trap and system call latency histograms.
+//
+//	kstats [-c cpu] [command [args...]]
+//
+// With a command, runs it and prints only the latencies recorded while
+// it ran.  Without -c, the histograms are summed over all CPUs.
+
+#include <inc/lib.h>
+
+static const char *sysnames[NSYSCALLS] = {
+	[SYS_cputs] = "cputs",
+	[SYS_cgetc] = "cgetc",
+	[SYS_getenvid] = "getenvid",
+	[SYS_env_destroy] = "env_destroy",
+	[SYS_page_alloc] = "page_alloc",
+	[SYS_page_map] = "page_map",
+	[SYS_page_unmap] = "page_unmap",
+	[SYS_exofork] = "exofork",
+	[SYS_env_set_status] = "env_set_status",
+	[SYS_env_set_trapframe] = "env_set_trapframe",
+	[SYS_env_set_pgfault_upcall] = "env_set_pgfault_upcall",
+	[SYS_yield] = "yield",
+	[SYS_ipc_try_send] = "ipc_try_send",
+	[SYS_ipc_recv] = "ipc_recv",
+	[SYS_execv] = "execv",
+	[SYS_futex_wait] = "futex_wait",
+	[SYS_futex_wake] = "futex_wake",
+	[SYS_idle_cycles] = "idle_cycles",
+	[SYS_env_exit] = "env_exit",
+	[SYS_wait] = "wait",
+	[SYS_wait_any] = "wait_any",
+	[SYS_cread] = "cread",
+	[SYS_trace_map] = "trace_map",
+	[SYS_stats] = "stats",
+	[SYS_prof_ctl] = "prof_ctl",
+	[SYS_prof_read] = "prof_read",
+	[SYS_ksym] = "ksym",
+	[SYS_time_ns] = "time_ns",
+	[SYS_sleep_ns] = "sleep_ns",
+	[SYS_env_set_priority] = "env_set_priority",
+	[SYS_env_set_affinity] = "env_set_affinity",
+	[SYS_env_stat] = "env_stat",
+	[SYS_pages_free] = "pages_free",
+};
+
+static struct Stats before, after;
+
+static void
+print_hist(const char *name, int n, struct Hist *h, struct Hist *h0)
+{
+	uint32_t count;
+	int b;
+
+	if ((count = h->h_count - h0->h_count) == 0)
+		return;
+	printf("%-24s %3d: %8u, avg %8llu cycles;", name ? name : "?", n,
+	       count, (h->h_cycles - h0->h_cycles) / count);
+	for (b = 0; b < STATS_NBUCKETS; b++)
+		if (h->h_bucket[b] != h0->h_bucket[b])
+			printf(" 2^%d:%u", b, h->h_bucket[b] - h0->h_bucket[b]);
+	printf("\n");
+}
+
+static void
+usage(void)
+{
+	printf("usage: kstats [-c cpu] [command [args...]]\n");
+	exit();
+}
+
+void
+umain(int argc, char **argv)
+{
+	int cpu = -1, r, i;
+
+	binaryname = "kstats";
+	if (argc >= 3 && strcmp(argv[1], "-c") == 0) {
+		cpu = strtol(argv[2], NULL, 0);
+		argc -= 2;
+		argv += 2;
+	} else if (argc >= 2 && argv[1][0] == '-')
+		usage();
+
+	if (argc >= 2) {
+		if ((r = sys_stats(cpu, &before)) < 0)
+			panic("sys_stats: %e", r);
+		if ((r = spawn(argv[1], (const char **) argv + 1)) < 0)
+			panic("spawn %s: %e", argv[1], r);
+		wait(r);
+	}
+	if ((r = sys_stats(cpu, &after)) < 0)
+		panic("sys_stats: %e", r);
+
+	for (i = 0; i < STATS_NTRAPS; i++)
+		print_hist(i == T_SYSCALL ? "System call"
+			   : i == T_PGFLT ? "Page fault"
+			   : i >= IRQ_OFFSET && i < IRQ_OFFSET + 16 ? "IRQ"
+			   : "trap", i, &after.st_trap[i], &before.st_trap[i]);
+	for (i = 0; i < NSYSCALLS; i++)
+		print_hist(sysnames[i], i, &after.st_syscall[i],
+			   &before.st_syscall[i]);
+}
@@ -0,0 +1,35 @@
+// Run a command at another scheduling priority:
+// nice [-n priority] command [args...].  Priorities go from -20 (most
+// CPU) to 19 (least); the default is 10.  The command's children
+// inherit it.
+
+#include <inc/lib.h>
+
+static void
+usage(void)
+{
+	printf("usage: nice [-n priority] command [args...]\n");
+	exit();
+}
+
+void
+umain(int argc, char **argv)
+{
+	int prio = 10, r;
+
+	binaryname = "nice";
+	if (argc >= 3 && strcmp(argv[1], "-n") == 0) {
+		prio = strtol(argv[2], NULL, 0);
+		argc -= 2;
+		argv += 2;
+	}
+	if (argc < 2 || argv[1][0] == '-')
+		usage();
+
+	// The child inherits our priority when spawn creates it.
+	if ((r = sys_env_set_priority(0, prio)) < 0)
+		panic("priority %d: %e", prio, r);
+	if ((r = spawn(argv[1], (const char **) argv + 1)) < 0)
+		panic("spawn %s: %e", argv[1], r);
+	wait(r);
+}
@@ -0,0 +1,41 @@
+// Time open()/close() pairs on one file, first with nothing else open
+// and then with many other files held open, to check that the file
+// server's open-file table allocation doesn't slow down as it fills.
+
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+#define NPAIRS	1000
+#define NHELD	28	// a process has 32 descriptors
+
+static uint64_t
+time_pairs(void)
+{
+	uint64_t start;
+	int i, fd;
+
+	start = read_tsc();
+	for (i = 0; i < NPAIRS; i++) {
+		if ((fd = open("/newmotd", O_RDONLY)) < 0)
+			panic("open: %e", fd);
+		close(fd);
+	}
+	return (read_tsc() - start) / NPAIRS;
+}
+
+void
+umain(int argc, char **argv)
+{
+	int fds[NHELD], i, n;
+
+	binaryname = "openbench";
+	printf("open/close: %llu cycles per pair\n", time_pairs());
+
+	for (n = 0; n < NHELD; n++)
+		if ((fds[n] = open("/newmotd", O_RDONLY)) < 0)
+			break;
+	printf("open/close with %d files open: %llu cycles per pair\n",
+	       n, time_pairs());
+	for (i = 0; i < n; i++)
+		close(fds[i]);
+}
@@ -0,0 +1,70 @@
+// IPC round trips between a client and a server, with no affinity set,
+// with both pinned to one CPU, and with each pinned to a CPU of its
+// own.  Reports the average round-trip time and how often the pair
+// moved between CPUs.
+
+#include <inc/lib.h>
+
+#define NROUNDS		10000
+
+static uint32_t online;
+
+static void
+server(void)
+{
+	envid_t from;
+	uint32_t v;
+
+	while (1) {
+		v = ipc_recv(&from, 0, 0);
+		ipc_send(from, v + 1, 0, 0);
+	}
+}
+
+// Nonzero masks pin the client and server; zero leaves them free.
+static void
+run(const char *what, uint32_t cmask, uint32_t smask)
+{
+	envid_t srv, me = sys_getenvid();
+	uint64_t start, took;
+	uint32_t moves;
+	int i, r;
+
+	if ((srv = fork()) < 0)
+		panic("fork: %e", srv);
+	if (srv == 0)
+		server();
+	if ((r = sys_env_set_affinity(srv, smask ? smask : online)) < 0
+	    || (r = sys_env_set_affinity(me, cmask ? cmask : online)) < 0)
+		panic("sys_env_set_affinity: %e", r);
+
+	moves = envs[ENVX(me)].env_migrations + envs[ENVX(srv)].env_migrations;
+	start = time_ns();
+	for (i = 0; i < NROUNDS; i++) {
+		ipc_send(srv, i, 0, 0);
+		if ((r = ipc_recv(0, 0, 0)) != i + 1)
+			panic("got %d, expected %d", r, i + 1);
+	}
+	took = time_ns() - start;
+	moves = envs[ENVX(me)].env_migrations + envs[ENVX(srv)].env_migrations
+		- moves;
+
+	printf("%-16s %6llu ns per round trip, %6llu migrations/s\n", what,
+	       took / NROUNDS, (uint64_t) moves * 1000000000 / took);
+	sys_env_destroy(srv);
+	wait(srv);
+}
+
+void
+umain(int argc, char **argv)
+{
+	binaryname = "pinbench";
+	if ((int) (online = sys_env_set_affinity(0, ~0)) < 0)
+		panic("sys_env_set_affinity: %e", online);
+
+	run("unpinned", 0, 0);
+	run("same CPU", 0x1, 0x1);
+	if (online & 0x2)
+		run("separate CPUs", 0x1, 0x2);
+	sys_env_set_affinity(0, online);
+}
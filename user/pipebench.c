@@ -0,0 +1,50 @@
+// Push data through a pipe from a child to its parent and report the
+// throughput.  "pipebench [kilobytes [chunk]]" moves 'kilobytes' KB
+// (default 1024) in write()s of 'chunk' bytes (default 4096).
+
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+char buf[8192];
+
+void
+umain(int argc, char **argv)
+{
+	int p[2], r, pid;
+	uint32_t total, chunk, n;
+	uint64_t start, cycles;
+
+	binaryname = "pipebench";
+	total = (argc > 1 ? strtol(argv[1], 0, 0) : 1024) * 1024;
+	chunk = argc > 2 ? strtol(argv[2], 0, 0) : 4096;
+	if (chunk == 0 || chunk > sizeof(buf))
+		panic("chunk must be 1..%d bytes", sizeof(buf));
+
+	if ((r = pipe(p)) < 0)
+		panic("pipe: %e", r);
+	if ((pid = fork()) < 0)
+		panic("fork: %e", pid);
+
+	if (pid == 0) {
+		close(p[0]);
+		memset(buf, 'x', sizeof(buf));
+		for (n = 0; n < total; n += r)
+			if ((r = write(p[1], buf, MIN(chunk, total - n))) <= 0)
+				panic("write: %e", r);
+		exit();
+	}
+
+	close(p[1]);
+	start = read_tsc();
+	for (n = 0; (r = read(p[0], buf, sizeof(buf))) > 0; n += r)
+		;
+	cycles = read_tsc() - start;
+	if (r < 0)
+		panic("read: %e", r);
+	if (n != total)
+		panic("read %d bytes, expected %d", n, total);
+	wait(pid);
+
+	printf("%d KB through a pipe in %llu cycles: %llu cycles/KB\n",
+	       n / 1024, cycles, cycles / (n / 1024 ? n / 1024 : 1));
+}
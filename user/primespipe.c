@@ -4,9 +4,8 @@
 // The picture halfway down the page and the text surrounding it
 // explain what's going on here.
 //
-// Since NENV is 1024, we can print 1022 primes before running out.
-// The remaining two environments are the integer generator at the bottom
-// of main and user/idle.
+// Each prime takes an environment of its own; with NENV at 32768,
+// memory runs out long before the environment table does.
 
 #include <inc/lib.h>
 
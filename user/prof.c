@@ -0,0 +1,108 @@
+// Run a command under the sampling profiler and print a flat profile.
+//
+//	prof [-p period] command [args...]
+//
+// Kernel samples are attributed to the kernel function they hit; user
+// samples to the environment and instruction address, since only the
+// kernel's symbols are at hand.  See kern/prof.c for what the period
+// counts.
+
+#include <inc/lib.h>
+
+#define NSAMPLES	32768
+#define NROWS		1024
+#define NSHOW		40
+#define NAMELEN		48
+
+struct Row {
+	char name[NAMELEN];
+	uint32_t count;
+};
+
+static struct ProfSample samples[NSAMPLES];
+static struct Row rows[NROWS];
+static int nrows, nother;
+
+static void
+add(const char *name)
+{
+	int i;
+
+	for (i = 0; i < nrows; i++)
+		if (strcmp(rows[i].name, name) == 0)
+			break;
+	if (i == nrows) {
+		if (nrows == NROWS) {
+			nother++;
+			return;
+		}
+		strncpy(rows[nrows].name, name, NAMELEN - 1);
+		nrows++;
+	}
+	rows[i].count++;
+}
+
+static void
+usage(void)
+{
+	printf("usage: prof [-p period] command [args...]\n");
+	exit();
+}
+
+void
+umain(int argc, char **argv)
+{
+	static const char *modes[] = {
+		[PROF_PMC] = "cycle counter", [PROF_TIMER] = "timer"
+	};
+	char name[NAMELEN];
+	uint32_t period = 1000000, lost;
+	struct Row t;
+	int i, j, n, r, mode;
+
+	binaryname = "prof";
+	if (argc >= 3 && strcmp(argv[1], "-p") == 0) {
+		period = strtol(argv[2], NULL, 0);
+		argc -= 2;
+		argv += 2;
+	}
+	if (argc < 2 || argv[1][0] == '-')
+		usage();
+
+	if ((mode = sys_prof_ctl(period)) < 0)
+		panic("sys_prof_ctl: %e", mode);
+	if ((r = spawn(argv[1], (const char **) argv + 1)) < 0)
+		panic("spawn %s: %e", argv[1], r);
+	wait(r);
+	sys_prof_ctl(0);
+
+	n = sys_prof_read(samples, NSAMPLES, &lost);
+	for (i = 0; i < n; i++) {
+		if (samples[i].ps_mode == PROF_IDLE)
+			strcpy(name, "(idle)");
+		else if (samples[i].ps_mode == PROF_KERNEL)
+			sys_ksym(samples[i].ps_eip, name, sizeof(name));
+		else
+			snprintf(name, sizeof(name), "[%08x] %08x",
+				 samples[i].ps_envid, samples[i].ps_eip);
+		add(name);
+	}
+
+	// Few rows, so a simple insertion sort does.
+	for (i = 1; i < nrows; i++) {
+		t = rows[i];
+		for (j = i; j > 0 && rows[j - 1].count < t.count; j--)
+			rows[j] = rows[j - 1];
+		rows[j] = t;
+	}
+
+	printf("%d samples every %u %s, %u lost\n", n, period,
+	       mode == PROF_PMC ? "cycles" : "ticks", lost);
+	printf("sampling by %s\n", modes[mode]);
+	for (i = 0; i < nrows && i < NSHOW; i++)
+		printf("%6u %3u%%  %s\n", rows[i].count,
+		       rows[i].count * 100 / n, rows[i].name);
+	if (nrows > NSHOW || nother)
+		printf("... %d more rows, %d samples unsorted\n",
+		       nrows - MIN(nrows, NSHOW), nother);
+}
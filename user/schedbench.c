@@ -0,0 +1,34 @@
+// Cost of the two envs[] searches that happen most: the scheduler's,
+// timed as a sys_yield with nothing else to run (so the whole table is
+// scanned and we come straight back), and ipc_find_env's, the first
+// time (a search) and after that (remembered).
+
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+#define NROUNDS	10000
+
+void
+umain(int argc, char **argv)
+{
+	uint64_t start, first;
+	envid_t fs;
+	int i;
+
+	binaryname = "schedbench";
+
+	start = read_tsc();
+	for (i = 0; i < NROUNDS; i++)
+		sys_yield();
+	printf("sys_yield: %llu cycles\n", (read_tsc() - start) / NROUNDS);
+
+	start = read_tsc();
+	fs = ipc_find_env(ENV_TYPE_FS);
+	first = read_tsc() - start;
+	start = read_tsc();
+	for (i = 0; i < NROUNDS; i++)
+		if (ipc_find_env(ENV_TYPE_FS) != fs)
+			panic("ipc_find_env changed its mind");
+	printf("ipc_find_env: %llu cycles first, %llu cycles after\n",
+	       first, (read_tsc() - start) / NROUNDS);
+}
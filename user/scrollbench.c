@@ -0,0 +1,52 @@
+// Measure how fast the console scrolls.  "scrollbench [lines]" (default
+// 2000) prints that many full-width lines, first one write per line
+// and then a screenful (25 lines) per write, and reports cycles per
+// line for each.  The serial port gets the same text, so this measures
+// the whole console path, not only the CGA screen.
+
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+#define COLS	80
+#define ROWS	25
+
+static char screen[ROWS * COLS];
+
+static uint64_t
+run(int nlines, int per_write)
+{
+	uint64_t start;
+	int i, n;
+
+	start = read_tsc();
+	for (i = 0; i < nlines; i += n) {
+		n = MIN(per_write, nlines - i);
+		sys_cputs(screen, n * COLS);
+	}
+	return (read_tsc() - start) / nlines;
+}
+
+void
+umain(int argc, char **argv)
+{
+	uint64_t one, batch;
+	int i, j, nlines;
+
+	binaryname = "scrollbench";
+	nlines = argc > 1 ? strtol(argv[1], 0, 0) : 2000;
+	if (nlines <= 0)
+		panic("usage: scrollbench [lines]");
+
+	// Fill lines with text, one short of the width so each line's
+	// newline doesn't also wrap.
+	for (i = 0; i < ROWS; i++) {
+		for (j = 0; j < COLS - 1; j++)
+			screen[i * COLS + j] = 'A' + (i + j) % 26;
+		screen[i * COLS + COLS - 1] = '\n';
+	}
+
+	one = run(nlines, 1);
+	batch = run(nlines, ROWS);
+	cprintf("%d lines: %llu cycles/line one at a time, %llu batched\n",
+		nlines, one, batch);
+}
@@ -258,6 +258,21 @@ gettoken(char *s, char **p1)
 	return c;
 }
 
+// If the command line ends in '&', remove the '&' and return 1: the
+// command runs in the background and the shell doesn't wait for it.
+int
+background(char *s)
+{
+	char *e = s + strlen(s);
+
+	while (e > s && strchr(WHITESPACE, e[-1]))
+		e--;
+	if (e == s || e[-1] != '&')
+		return 0;
+	e[-1] = 0;
+	return 1;
+}
+
 
 void
 usage(void)
@@ -269,7 +284,7 @@ usage(void)
 void
 umain(int argc, char **argv)
 {
-	int r, interactive, echocmds;
+	int r, interactive, echocmds, bg;
 	struct Argstate args;
 
 	interactive = '?';
@@ -316,6 +331,7 @@ umain(int argc, char **argv)
 			continue;
 		if (echocmds)
 			printf("# %s\n", buf);
+		bg = background(buf);
 		if (debug)
 			cprintf("BEFORE FORK\n");
 		if ((r = fork()) < 0)
@@ -325,7 +341,9 @@ umain(int argc, char **argv)
 		if (r == 0) {
 			runcmd(buf);
 			exit();
-		} else
+		} else if (bg)
+			printf("[%08x]\n", r);
+		else
 			wait(r);
 	}
 }
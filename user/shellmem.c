@@ -0,0 +1,66 @@
+// Report the physical memory taken by n shells running at once:
+// "shellmem [n]" (default 10).  Each shell reads commands from a pipe
+// that never gets any, so it sits blocked while we look.  Prints the
+// free pages used up by each shell, and for the last one how many of
+// the pages it maps are shared with the others.
+//
+// One shell is started and killed first, so that the file server's
+// block cache already holds /sh and isn't counted against the others.
+
+#include <inc/lib.h>
+
+#define NSHELLS		64
+#define SETTLE_NS	(50 * 1000 * 1000)
+
+// Start a shell and give it time to block reading its input.
+static envid_t
+start_shell(void)
+{
+	envid_t r;
+
+	if ((r = spawnl("/sh", "sh", 0)) < 0)
+		panic("spawn /sh: %e", r);
+	sys_sleep_ns(SETTLE_NS);
+	return r;
+}
+
+void
+umain(int argc, char **argv)
+{
+	envid_t shells[NSHELLS];
+	struct EnvStat st;
+	int p[2], n, i, r, free0, free1, prev;
+
+	binaryname = "shellmem";
+	n = argc > 1 ? strtol(argv[1], 0, 0) : 10;
+	if (n <= 0 || n > NSHELLS)
+		panic("usage: shellmem [n], n at most %d", NSHELLS);
+
+	// Our stdin becomes the pipe; the shells inherit it.
+	if ((r = pipe(p)) < 0)
+		panic("pipe: %e", r);
+	if ((r = dup(p[0], 0)) < 0)
+		panic("dup: %e", r);
+	close(p[0]);
+
+	sys_env_destroy(start_shell());
+	sys_sleep_ns(SETTLE_NS);
+
+	free0 = prev = sys_pages_free();
+	for (i = 0; i < n; i++) {
+		shells[i] = start_shell();
+		free1 = sys_pages_free();
+		printf("shell %d: %d pages\n", i + 1, prev - free1);
+		prev = free1;
+	}
+	printf("%d shells: %d pages, %d per shell\n", n, free0 - prev,
+	       (free0 - prev) / n);
+
+	if ((r = sys_env_stat(shells[n - 1], &st)) < 0)
+		panic("sys_env_stat: %e", r);
+	printf("last shell maps %u pages, %u of them shared, "
+	       "plus %u page tables\n", st.es_pages, st.es_shared, st.es_ptables);
+
+	for (i = 0; i < n; i++)
+		sys_env_destroy(shells[i]);
+}
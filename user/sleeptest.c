@@ -0,0 +1,58 @@
+// Check timed sleeps and waits: sys_sleep_ns should return after (not
+// before) the time asked for, and ipc_recv_timeout and
+// sys_futex_wait_timeout should give up with -E_TIMEOUT when nothing
+// wakes them, but return normally when something does.
+
+#include <inc/lib.h>
+
+static volatile uint32_t word;
+
+static void
+check_sleep(uint64_t ns)
+{
+	uint64_t start, took;
+
+	start = time_ns();
+	sys_sleep_ns(ns);
+	took = time_ns() - start;
+	if (took < ns)
+		panic("slept %llu ns, asked for %llu", took, ns);
+	printf("sleep %llu us: %llu us\n", ns / 1000, took / 1000);
+}
+
+void
+umain(int argc, char **argv)
+{
+	uint64_t start;
+	envid_t child, from;
+	int r;
+
+	binaryname = "sleeptest";
+	check_sleep(1000000);
+	check_sleep(5000000);
+	check_sleep(50000000);
+
+	start = time_ns();
+	r = ipc_recv_timeout(&from, 0, 0, 20000000);
+	if (r != -E_TIMEOUT || time_ns() - start < 20000000)
+		panic("ipc_recv_timeout: got %e", r);
+
+	start = time_ns();
+	r = sys_futex_wait_timeout(&word, 0, -1, 20000000);
+	if (r != -E_TIMEOUT || time_ns() - start < 20000000)
+		panic("sys_futex_wait_timeout: got %e", r);
+
+	// A message that arrives in time beats the timeout.
+	if ((child = fork()) < 0)
+		panic("fork: %e", child);
+	if (child == 0) {
+		sys_sleep_ns(10000000);
+		ipc_send(thisenv->env_parent_id, 42, 0, 0);
+		exit();
+	}
+	if ((r = ipc_recv_timeout(&from, 0, 0, 1000000000ULL)) != 42)
+		panic("ipc_recv_timeout: got %d from %08x", r, from);
+	wait(child);
+
+	printf("sleeptest OK\n");
+}
@@ -0,0 +1,79 @@
+// Measure spawn+wait throughput.  "spawnbench [n]" (default 50) times
+// n runs of /true three ways: spawned and waited for one at a time,
+// spawned all at once and reaped with wait_any, and through the shell,
+// from a script of n "true" lines.  Waiting twice for the same child
+// must fail the second time.
+
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+#define SCRIPT	"/spawnbench.sh"
+
+static void
+report(const char *what, int n, uint64_t cycles)
+{
+	printf("%s: %d in %llu cycles, %llu cycles each\n",
+	       what, n, cycles, cycles / n);
+}
+
+// Spawn /true with the given exit status.
+static envid_t
+spawn_true(int status)
+{
+	char buf[16];
+	envid_t r;
+
+	snprintf(buf, sizeof(buf), "%d", status);
+	if ((r = spawnl("/true", "true", buf, 0)) < 0)
+		panic("spawn /true: %e", r);
+	return r;
+}
+
+void
+umain(int argc, char **argv)
+{
+	int i, n, r, fd, status;
+	envid_t pid;
+	uint64_t start;
+
+	binaryname = "spawnbench";
+	n = argc > 1 ? strtol(argv[1], 0, 0) : 50;
+	if (n <= 0)
+		panic("usage: spawnbench [n]");
+
+	start = read_tsc();
+	for (i = 0; i < n; i++) {
+		pid = spawn_true(i);
+		if ((r = wait_status(pid, &status)) != pid)
+			panic("wait_status %08x: %e", pid, r);
+		if (status != i)
+			panic("child %d exited with %d", i, status);
+		if ((r = sys_wait(pid, &status)) != -E_BAD_ENV)
+			panic("second wait for %08x: got %e", pid, r);
+	}
+	report("spawn+wait", n, read_tsc() - start);
+
+	start = read_tsc();
+	for (i = 0; i < n; i++)
+		spawn_true(7);
+	for (i = 0; i < n; i++) {
+		if ((pid = wait_any(&status)) < 0)
+			panic("wait_any: %e", pid);
+		if (status != 7)
+			panic("child %08x exited with %d", pid, status);
+	}
+	if ((r = wait_any(&status)) != -E_BAD_ENV)
+		panic("wait_any with no children: got %e", r);
+	report("spawn all+wait_any", n, read_tsc() - start);
+
+	if ((fd = open(SCRIPT, O_WRONLY|O_CREAT|O_TRUNC)) < 0)
+		panic("open %s: %e", SCRIPT, fd);
+	for (i = 0; i < n; i++)
+		fprintf(fd, "true\n");
+	close(fd);
+	start = read_tsc();
+	if ((pid = spawnl("/sh", "sh", SCRIPT, 0)) < 0)
+		panic("spawn /sh: %e", pid);
+	wait(pid);
+	report("sh script", n, read_tsc() - start);
+}
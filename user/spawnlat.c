@@ -0,0 +1,226 @@
+// Measure spawn and exec latency: the time from calling spawn() or
+// execv() until the program is running its umain, for this program and
+// for a copy of it carrying two large segments it never touches, one
+// read-only and one writable.  Since segments are mapped from the block
+// cache rather than read in, the big copy should start about as fast as
+// the small one.  For exec it also shows the pages the environment
+// holds before and after; the kernel stages nothing in between, so the
+// larger of the two is the peak.
+//
+// "spawnlat [n]" (default 20) averages n runs of each.  The big copy is
+// made as large as the disk has room for, up to BIGSIZE, and truncated
+// to nothing afterwards.
+//
+// The program is also its own child: "-c" just reports in, "-e path"
+// waits for the word and then execs path with "-x", and "-x start"
+// reports how long ago start was and waits to be let go.
+
+#include <inc/lib.h>
+#include <inc/elf.h>
+
+#define SELF	"/spawnlat"
+#define BIG	"/spawnlat.big"
+#define BIGSIZE	(4 << 20)
+#define MINSIZE	(256 << 10)
+#define BIGVA	0x10000000
+
+static char buf[PGSIZE];
+
+// Write a copy of SELF with two more segments of 'size' bytes, both
+// backed by the same filler at the end of the file.  Returns 0, or < 0
+// if the copy can't be made.
+static int
+make_big(int size)
+{
+	struct Elf *elf = (struct Elf *) buf;
+	struct Proghdr *ph;
+	struct Stat st;
+	int src, dst, i, n, r;
+	uint32_t filler;
+
+	if ((src = open(SELF, O_RDONLY)) < 0)
+		return src;
+	if ((r = fstat(src, &st)) < 0
+	    || (dst = r = open(BIG, O_WRONLY|O_CREAT|O_TRUNC)) < 0) {
+		close(src);
+		return r;
+	}
+	filler = ROUNDUP(st.st_size, PGSIZE);
+
+	for (i = 0; (n = readn(src, buf, PGSIZE)) > 0; i += n) {
+		if (i == 0) {
+			// spawn reads the program headers from the first 512
+			// bytes, so there must be room there for two more.
+			ph = (struct Proghdr *) (buf + elf->e_phoff);
+			if (elf->e_magic != ELF_MAGIC
+			    || elf->e_phoff + (elf->e_phnum + 2) * sizeof(*ph) > 512)
+				panic("no room for more program headers in %s", SELF);
+			for (r = 0; r < elf->e_phnum; r++)
+				if (ph[r].p_type == ELF_PROG_LOAD && ph[r].p_filesz > 0
+				    && ph[r].p_offset < elf->e_phoff + (elf->e_phnum + 2) * sizeof(*ph))
+					panic("program headers in %s overlap a segment", SELF);
+			ph += elf->e_phnum;
+			elf->e_phnum += 2;
+			for (r = 0; r < 2; r++, ph++) {
+				ph->p_type = ELF_PROG_LOAD;
+				ph->p_offset = filler;
+				ph->p_va = ph->p_pa = BIGVA + r * ROUNDUP(size, PTSIZE);
+				ph->p_filesz = ph->p_memsz = size;
+				ph->p_flags = ELF_PROG_FLAG_READ | (r ? ELF_PROG_FLAG_WRITE : 0);
+				ph->p_align = PGSIZE;
+			}
+		}
+		if ((r = write(dst, buf, n)) != n)
+			goto short_write;
+	}
+	if ((r = n) < 0)
+		goto out;
+
+	memset(buf, 0xAA, PGSIZE);
+	if ((r = ftruncate(dst, filler)) < 0 || (r = seek(dst, filler)) < 0)
+		goto out;
+	for (i = 0; i < size; i += n) {
+		n = MIN(size - i, PGSIZE);
+		if ((r = write(dst, buf, n)) != n)
+			goto short_write;
+	}
+	r = 0;
+	goto out;
+short_write:
+	if (r >= 0)
+		r = -E_NO_DISK;
+out:
+	if (r < 0)
+		ftruncate(dst, 0);
+	close(src);
+	close(dst);
+	return r;
+}
+
+// Wait for a message from child.
+static uint32_t
+expect(envid_t child)
+{
+	envid_t from;
+	uint32_t v;
+
+	v = ipc_recv(&from, 0, 0);
+	if (from != child)
+		panic("heard from %08x, expected %08x", from, child);
+	return v;
+}
+
+// Spawn path n times, printing the average time until spawn() returned
+// and until the child was running.
+static void
+run(const char *path, const char *what, int n)
+{
+	uint64_t start, spawned = 0, running = 0;
+	envid_t child;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		start = time_ns();
+		if ((child = spawnl(path, "spawnlat", "-c", 0)) < 0)
+			panic("spawn %s: %e", path, child);
+		spawned += time_ns() - start;
+		expect(child);
+		running += time_ns() - start;
+		wait(child);
+	}
+	printf("%s: spawn() returns in %llu us, child running in %llu us\n",
+	       what, spawned / n / 1000, running / n / 1000);
+}
+
+// Pages env holds on its own.
+static uint32_t
+private_pages(envid_t env)
+{
+	struct EnvStat st;
+	int r;
+
+	if ((r = sys_env_stat(env, &st)) < 0)
+		panic("sys_env_stat: %e", r);
+	return st.es_pages - st.es_shared + st.es_ptables;
+}
+
+// Have a child exec path n times, printing the average time until the
+// new program was running, and the child's own pages before and after.
+static void
+run_exec(const char *path, const char *what, int n)
+{
+	uint64_t ns = 0;
+	uint32_t before = 0, after = 0;
+	envid_t child;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		if ((child = spawnl(SELF, "spawnlat", "-e", path, 0)) < 0)
+			panic("spawn %s: %e", SELF, child);
+		expect(child);
+		before = private_pages(child);
+		ipc_send(child, 0, 0, 0);
+		ns += expect(child);
+		after = private_pages(child);
+		ipc_send(child, 0, 0, 0);
+		wait(child);
+	}
+	printf("%s: exec'd program running in %llu us, "
+	       "%u private pages before, %u after\n",
+	       what, ns / n / 1000, before, after);
+}
+
+static uint64_t
+parse_u64(const char *s)
+{
+	uint64_t v = 0;
+
+	while (*s >= '0' && *s <= '9')
+		v = v * 10 + *s++ - '0';
+	return v;
+}
+
+void
+umain(int argc, char **argv)
+{
+	envid_t parent = thisenv->env_parent_id;
+	char what[32], start[24];
+	int n, size, r;
+
+	if (argc > 1 && strcmp(argv[1], "-c") == 0) {
+		ipc_send(parent, 0, 0, 0);
+		return;
+	}
+	if (argc > 2 && strcmp(argv[1], "-e") == 0) {
+		ipc_send(parent, 0, 0, 0);
+		ipc_recv(0, 0, 0);
+		snprintf(start, sizeof(start), "%llu", time_ns());
+		r = execl(argv[2], "spawnlat", "-x", start, 0);
+		panic("exec %s: %e", argv[2], r);
+	}
+	if (argc > 2 && strcmp(argv[1], "-x") == 0) {
+		ipc_send(parent, time_ns() - parse_u64(argv[2]), 0, 0);
+		ipc_recv(0, 0, 0);
+		return;
+	}
+
+	binaryname = "spawnlat";
+	n = argc > 1 ? strtol(argv[1], 0, 0) : 20;
+	if (n <= 0)
+		panic("usage: spawnlat [n]");
+
+	run(SELF, "small", n);
+	run_exec(SELF, "small", n);
+	for (size = BIGSIZE; size >= MINSIZE; size /= 2)
+		if ((r = make_big(size)) == 0)
+			break;
+	if (size < MINSIZE) {
+		printf("no room on disk for a big binary: %e\n", r);
+		return;
+	}
+	snprintf(what, sizeof(what), "2 x %d KB segments", size / 1024);
+	run(BIG, what, n);
+	run_exec(BIG, what, n);
+	if ((r = open(BIG, O_WRONLY|O_TRUNC)) >= 0)
+		close(r);
+}
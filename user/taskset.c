@@ -0,0 +1,52 @@
+// Choose the CPUs environments may run on.  A mask has bit i set for
+// CPU i; children inherit it.
+//
+//	taskset mask command [args...]	run command on those CPUs
+//	taskset -p mask envid		move an existing environment
+//	taskset -f mask			move the file server
+//
+// To give the file server a CPU of its own, pin it there and keep
+// everything else off it: "taskset -f 0x1" and then "taskset 0xe sh".
+
+#include <inc/lib.h>
+
+static void
+usage(void)
+{
+	printf("usage: taskset mask command [args...]\n"
+	       "       taskset -p mask envid\n"
+	       "       taskset -f mask\n");
+	exit();
+}
+
+static void
+set(envid_t envid, uint32_t mask)
+{
+	int r;
+
+	if ((r = sys_env_set_affinity(envid, mask)) < 0)
+		panic("affinity %08x: %e", envid, r);
+	printf("%08x: CPUs %x\n", envid, r);
+}
+
+void
+umain(int argc, char **argv)
+{
+	uint32_t mask;
+	int r;
+
+	binaryname = "taskset";
+	if (argc == 4 && strcmp(argv[1], "-p") == 0)
+		set(strtol(argv[3], NULL, 16), strtol(argv[2], NULL, 0));
+	else if (argc == 3 && strcmp(argv[1], "-f") == 0)
+		set(ipc_find_env(ENV_TYPE_FS), strtol(argv[2], NULL, 0));
+	else if (argc >= 3 && argv[1][0] != '-') {
+		mask = strtol(argv[1], NULL, 0);
+		if ((r = sys_env_set_affinity(0, mask)) < 0)
+			panic("affinity %x: %e", mask, r);
+		if ((r = spawn(argv[2], (const char **) argv + 2)) < 0)
+			panic("spawn %s: %e", argv[2], r);
+		wait(r);
+	} else
+		usage();
+}
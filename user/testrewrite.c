@@ -0,0 +1,135 @@
+// Check that rewriting a program's binary doesn't change a running
+// instance of it.  Spawned programs map their text, and their data
+// copy-on-write, straight from the file server's block cache, so the
+// server must not write into those pages: not when the binary is
+// overwritten in place, and not when it is truncated and its blocks
+// are reused for other data.
+//
+// The parent copies its own binary to BIN and spawns the copy, which
+// checksums its text and some initialized data it never writes.  The
+// parent then overwrites BIN with junk, truncates it and fills the disk
+// with JUNK, so that every block BIN had is reused, and lets the child
+// checksum its text and data again and run on.
+
+#include <inc/lib.h>
+
+#define BIN	"/testrewrite.bin"
+#define JUNK	"/testrewrite.junk"
+
+extern char etext[];
+
+static char buf[BLKSIZE];
+// Spans whole pages of .data, which are mapped from the file.
+static char data[3 * PGSIZE] = "testrewrite data";
+
+static uint32_t
+sum(const char *p, const char *end, uint32_t h)
+{
+	for (; p < end; p++)
+		h = (h ^ *p) * 16777619U;
+	return h;
+}
+
+static uint32_t
+image_sum(void)
+{
+	return sum(data, data + sizeof(data), sum((char *) UTEXT, etext, 0));
+}
+
+static void
+child(void)
+{
+	uint32_t before;
+	envid_t parent = thisenv->env_parent_id;
+
+	before = image_sum();
+	ipc_send(parent, 0, 0, 0);
+	ipc_recv(0, 0, 0);
+	if (image_sum() != before)
+		exit_status(1);
+}
+
+static void
+copy(const char *src, const char *dst)
+{
+	int rfd, wfd, n, r;
+
+	if ((rfd = open(src, O_RDONLY)) < 0)
+		panic("open %s: %e", src, rfd);
+	if ((wfd = open(dst, O_WRONLY|O_CREAT|O_TRUNC)) < 0)
+		panic("open %s: %e", dst, wfd);
+	while ((n = read(rfd, buf, sizeof(buf))) > 0)
+		if ((r = write(wfd, buf, n)) != n)
+			panic("write %s: %e", dst, r);
+	if (n < 0)
+		panic("read %s: %e", src, n);
+	close(rfd);
+	close(wfd);
+}
+
+// Overwrite every byte of path with junk, in place.
+static void
+scribble(const char *path)
+{
+	struct Stat st;
+	int fd, n, r;
+
+	if ((fd = open(path, O_WRONLY)) < 0)
+		panic("open %s: %e", path, fd);
+	if ((r = fstat(fd, &st)) < 0)
+		panic("stat %s: %e", path, r);
+	memset(buf, 0x5a, sizeof(buf));
+	for (; st.st_size > 0; st.st_size -= n) {
+		n = MIN(st.st_size, sizeof(buf));
+		if ((r = write(fd, buf, n)) != n)
+			panic("write %s: %e", path, r);
+	}
+	close(fd);
+}
+
+// Write junk to a new file until the disk is full.
+static int
+fill(void)
+{
+	int fd;
+
+	if ((fd = open(JUNK, O_WRONLY|O_CREAT|O_TRUNC)) < 0)
+		panic("open %s: %e", JUNK, fd);
+	memset(buf, 0xa5, sizeof(buf));
+	while (write(fd, buf, sizeof(buf)) == sizeof(buf))
+		;
+	return fd;
+}
+
+void
+umain(int argc, char **argv)
+{
+	int fd, r, status;
+	envid_t pid;
+
+	binaryname = "testrewrite";
+	if (argc > 1 && strcmp(argv[1], "child") == 0) {
+		child();
+		return;
+	}
+
+	copy("/testrewrite", BIN);
+	if ((pid = spawnl(BIN, "testrewrite", "child", 0)) < 0)
+		panic("spawn %s: %e", BIN, pid);
+	ipc_recv(0, 0, 0);
+
+	scribble(BIN);
+	if ((fd = open(BIN, O_WRONLY|O_TRUNC)) < 0)
+		panic("truncate %s: %e", BIN, fd);
+	close(fd);
+	fd = fill();
+	ipc_send(pid, 0, 0, 0);
+	if ((r = wait_status(pid, &status)) != pid)
+		panic("wait %08x: %e", pid, r);
+
+	ftruncate(fd, 0);
+	close(fd);
+	if (status != 0)
+		panic("child's image changed under it (status %d)", status);
+	printf("running program unaffected by rewriting its binary\n");
+}
@@ -0,0 +1,43 @@
+// Check the user-space clock against sys_time_ns and time both.
+// time_ns() should agree with the kernel to within the cost of a
+// system call, never go backwards, and be far cheaper than trapping.
+
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+#define NROUNDS	10000
+
+void
+umain(int argc, char **argv)
+{
+	uint64_t t0, t1, k, start, user, sys;
+	int i;
+
+	binaryname = "timetest";
+	if (!vtime.vt_tsc_hz)
+		panic("clock not calibrated");
+	printf("TSC %llu Hz, LAPIC timer %u Hz\n", vtime.vt_tsc_hz,
+	       vtime.vt_lapic_hz);
+
+	t0 = time_ns();
+	for (i = 0; i < NROUNDS; i++) {
+		sys_time_ns(&k);
+		t1 = time_ns();
+		if (k < t0 || t1 < k)
+			panic("clock went backwards: %llu %llu %llu", t0, k, t1);
+		t0 = t1;
+		if (i % 1000 == 0)
+			sys_yield();
+	}
+
+	start = read_tsc();
+	for (i = 0; i < NROUNDS; i++)
+		time_ns();
+	user = (read_tsc() - start) / NROUNDS;
+	start = read_tsc();
+	for (i = 0; i < NROUNDS; i++)
+		sys_time_ns(&k);
+	sys = (read_tsc() - start) / NROUNDS;
+	printf("time_ns %llu cycles, sys_time_ns %llu cycles\n", user, sys);
+	printf("timetest OK\n");
+}
@@ -0,0 +1,159 @@
+// Show which environments are using the CPUs: every interval, list
+// the busiest ones with the share of a CPU each spent in user mode, in
+// the kernel, and blocked in ipc_recv since the last listing, and the
+// pages it has mapped (page tables included) and how many of those
+// other environments share.
+//
+//	top [-d seconds] [-n listings]
+//
+// By default it lists every second until killed.
+
+#include <inc/lib.h>
+
+#define NROWS		20
+
+// Two snapshots and the sort order, one entry per envs[] slot.  They
+// live in pages mapped above the program's end as the environment
+// table grows, rather than in NENV-sized arrays.
+static struct EnvStat *stats[2];
+static int *order;
+
+// Make sure [va, va + len) is mapped.
+static void
+reserve(void *va, size_t len)
+{
+	uintptr_t p;
+	int r;
+
+	for (p = ROUNDDOWN((uintptr_t) va, PGSIZE); p < (uintptr_t) va + len;
+	     p += PGSIZE)
+		if (!(uvpd[PDX(p)] & PTE_P) || !(uvpt[PGNUM(p)] & PTE_P))
+			if ((r = sys_page_alloc(0, (void *) p,
+						PTE_P|PTE_U|PTE_W)) < 0)
+				panic("sys_page_alloc: %e", r);
+}
+
+static const char *
+status(unsigned s)
+{
+	switch (s) {
+	case ENV_RUNNABLE:
+		return "R";
+	case ENV_RUNNING:
+		return "run";
+	case ENV_NOT_RUNNABLE:
+		return "S";
+	case ENV_DYING:
+		return "D";
+	default:
+		return "?";
+	}
+}
+
+// Take a snapshot of every environment into st, and return the number
+// of slots looked at.  Free slots, and ones that vanish under us, get
+// es_id 0.
+static int
+snapshot(struct EnvStat *st)
+{
+	int i, n;
+
+	n = envs_mapped();
+	reserve(st, n * sizeof(*st));
+	reserve(order, n * sizeof(*order));
+	for (i = 0; i < n; i++)
+		if (envs[i].env_status == ENV_FREE
+		    || sys_env_stat(envs[i].env_id, &st[i]) < 0)
+			st[i].es_id = 0;
+	return n;
+}
+
+static uint64_t
+busy(const struct EnvStat *cur, const struct EnvStat *old)
+{
+	return cur->es_user_ns + cur->es_kernel_ns
+		- old->es_user_ns - old->es_kernel_ns;
+}
+
+static void
+usage(void)
+{
+	printf("usage: top [-d seconds] [-n listings]\n");
+	exit();
+}
+
+void
+umain(int argc, char **argv)
+{
+	extern char end[];
+	struct EnvStat *cur, *old;
+	uint64_t interval = 1000000000, t, idle, idle0, elapsed;
+	int count = 0, iter, ncpu, nold, ncur, n, i, j, k;
+
+	binaryname = "top";
+	for (i = 1; i < argc; i += 2) {
+		if (i + 1 >= argc)
+			usage();
+		if (strcmp(argv[i], "-d") == 0)
+			interval = strtol(argv[i + 1], NULL, 0) * 1000000000ULL;
+		else if (strcmp(argv[i], "-n") == 0)
+			count = strtol(argv[i + 1], NULL, 0);
+		else
+			usage();
+	}
+
+	stats[0] = (struct EnvStat *) ROUNDUP((uintptr_t) end, PGSIZE);
+	stats[1] = stats[0] + NENV;
+	order = (int *) ROUNDUP((uintptr_t) (stats[1] + NENV), PGSIZE);
+
+	ncpu = sys_idle_cycles(&idle0);
+	t = time_ns();
+	ncur = snapshot(stats[0]);
+	for (iter = 1; count == 0 || iter <= count; iter++) {
+		sys_sleep_ns(interval);
+		old = stats[(iter - 1) % 2];
+		cur = stats[iter % 2];
+		sys_idle_cycles(&idle);
+		elapsed = time_ns() - t;
+		t += elapsed;
+		nold = ncur;
+		ncur = snapshot(cur);
+
+		// Busiest first, among environments present both times.
+		n = 0;
+		for (i = 0; i < MIN(nold, ncur); i++) {
+			if (!cur[i].es_id || cur[i].es_id != old[i].es_id)
+				continue;
+			for (j = n++; j > 0
+			     && busy(&cur[order[j - 1]], &old[order[j - 1]])
+				< busy(&cur[i], &old[i]); j--)
+				order[j] = order[j - 1];
+			order[j] = i;
+		}
+
+		printf("\n%d environments, %d CPUs, %llu%% idle\n", n, ncpu,
+		       vtime_cycles2ns(&vtime, idle - idle0) * 100
+		       / (elapsed * ncpu));
+		printf("env      parent   st  pri cpu  user%%  sys%%  ipc%%"
+		       "   runs  moves  pages   shr\n");
+		for (k = 0; k < n && k < NROWS; k++) {
+			i = order[k];
+			printf("%08x %08x %-3s %3d %3d %5llu %5llu %5llu %6u %6u"
+			       " %6u %5u\n",
+			       cur[i].es_id, cur[i].es_parent_id,
+			       status(cur[i].es_status), cur[i].es_priority,
+			       cur[i].es_cpunum,
+			       (cur[i].es_user_ns - old[i].es_user_ns) * 100
+			       / elapsed,
+			       (cur[i].es_kernel_ns - old[i].es_kernel_ns) * 100
+			       / elapsed,
+			       (cur[i].es_ipc_ns - old[i].es_ipc_ns) * 100
+			       / elapsed,
+			       cur[i].es_runs - old[i].es_runs,
+			       cur[i].es_migrations - old[i].es_migrations,
+			       cur[i].es_pages + cur[i].es_ptables,
+			       cur[i].es_shared);
+		}
+		idle0 = idle;
+	}
+}
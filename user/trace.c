@@ -0,0 +1,108 @@
+// Dump the kernel's trace rings.  "trace" prints every event still in
+// the rings; "trace command [args...]" runs the command and prints the
+// events logged while it ran.  Output is one event per line, merged
+// across CPUs in time order:
+//	tsc cpu type envid arg0 arg1 arg2
+
+#include <inc/lib.h>
+#include <inc/trace.h>
+
+#define TRACEVA		((char *) 0xB0000000)
+#define MAXCPU		8		// NCPU in kern/cpu.h
+
+static const char *names[] = {
+	[TRACE_TRAP] = "trap",
+	[TRACE_SYSCALL] = "syscall",
+	[TRACE_RUN] = "run",
+	[TRACE_PGFAULT] = "pgfault",
+	[TRACE_IPC_SEND] = "ipc_send",
+	[TRACE_IPC_RECV] = "ipc_recv",
+	[TRACE_HALT] = "halt",
+};
+
+static int ncpu;
+static uint32_t next[MAXCPU];	// Next event to print, per CPU
+static uint32_t end[MAXCPU];	// Events logged when we took the copy
+static struct TraceEvent copy[MAXCPU][TRACE_NEVENTS];
+
+static struct TraceBuf *
+ring(int cpu)
+{
+	return (struct TraceBuf *) (TRACEVA + cpu * TRACE_BUFSIZE);
+}
+
+// Copy the rings, so that the events printing logs don't overwrite
+// the ones being printed, and work out which events are intact.
+static void
+snapshot(void)
+{
+	uint32_t head, oldest;
+	int cpu;
+
+	for (cpu = 0; cpu < ncpu; cpu++) {
+		end[cpu] = ring(cpu)->tb_head;
+		memcpy(copy[cpu], ring(cpu)->tb_ev, sizeof(copy[cpu]));
+		// Anything the kernel could have overwritten during the
+		// copy is suspect.
+		head = ring(cpu)->tb_head;
+		oldest = head > TRACE_NEVENTS - 1 ? head - (TRACE_NEVENTS - 1) : 0;
+		if (oldest > next[cpu]) {
+			if (next[cpu])
+				printf("# cpu %d: %d events lost\n", cpu,
+				       oldest - next[cpu]);
+			next[cpu] = MIN(oldest, end[cpu]);
+		}
+	}
+}
+
+// Print the copied events, merged across CPUs in time order.
+static void
+dump(void)
+{
+	struct TraceEvent *te, *best;
+	int cpu, bestcpu;
+
+	snapshot();
+	while (1) {
+		bestcpu = -1;
+		best = NULL;
+		for (cpu = 0; cpu < ncpu; cpu++) {
+			if (next[cpu] == end[cpu])
+				continue;
+			te = &copy[cpu][next[cpu] % TRACE_NEVENTS];
+			if (!best || te->te_tsc < best->te_tsc) {
+				best = te;
+				bestcpu = cpu;
+			}
+		}
+		if (!best)
+			break;
+		next[bestcpu]++;
+		printf("%llu %d %s %08x %x %x %x\n", best->te_tsc, bestcpu,
+		       best->te_type < ARRAY_SIZE(names) && names[best->te_type]
+		       ? names[best->te_type] : "?",
+		       best->te_envid, best->te_arg[0], best->te_arg[1],
+		       best->te_arg[2]);
+	}
+}
+
+void
+umain(int argc, char **argv)
+{
+	envid_t pid;
+	int cpu;
+
+	binaryname = "trace";
+	if ((ncpu = sys_trace_map(TRACEVA)) < 0)
+		panic("sys_trace_map: %e", ncpu);
+	ncpu = MIN(ncpu, MAXCPU);
+
+	if (argc > 1) {
+		for (cpu = 0; cpu < ncpu; cpu++)
+			next[cpu] = ring(cpu)->tb_head;
+		if ((pid = spawn(argv[1], (const char **) argv + 1)) < 0)
+			panic("spawn %s: %e", argv[1], pid);
+		wait(pid);
+	}
+	dump();
+}
@@ -0,0 +1,9 @@
+// Do nothing, successfully.  With an argument, exit with that status.
+#include <inc/lib.h>
+
+void
+umain(int argc, char **argv)
+{
+	if (argc > 1)
+		exit_status(strtol(argv[1], 0, 0));
+}